@@ -1131,12 +1131,19 @@ struct animmodel : model
         if(bih) loopv(parts) parts[i]->preloadBIH();
     }
 
-    BIH *setBIH()
+    BIH *newBIH()
     {
-        if(bih) return bih;
         vector<BIH::tri> tris[2];
         gentris(0, tris);
-        bih = new BIH(tris);
+        return new BIH(tris);
+    }
+
+    BIH *setBIH()
+    {
+        if(bih) return bih;
+        bih = newBIH();
+        string key;
+        bih->buildnodes(bih->cachekey(name(), key) ? key : NULL);
         return bih;
     }
 
@@ -128,6 +128,94 @@ inline bool BIH::traverse(const vec &o, const vec &ray, float maxdist, float &di
     return BIH::traverse(o, ray, invray, maxdist, dist, mode, &nodes[0], tmin, tmax); 
 }
 
+VAR(bihsah, 0, 1, 1);
+
+#define BIHSAHBINS 16
+
+static inline float bihboxarea(const vec &bmin, const vec &bmax)
+{
+    vec d = vec(bmax).sub(bmin);
+    return d.x*d.y + d.y*d.z + d.z*d.x;
+}
+
+// bins triangle centroids along each axis and partitions indices at the cheapest surface area split, returns the size of the left side or 0
+int BIH::sahpartition(ushort *indices, int numindices, int &axis)
+{
+    vec cmin(1e16f, 1e16f, 1e16f), cmax(-1e16f, -1e16f, -1e16f);
+    loopi(numindices)
+    {
+        tri &tri = tris[indices[i]];
+        vec c = vec(tri.a).add(tri.b).add(tri.c).mul(1.0f/3);
+        cmin.min(c);
+        cmax.max(c);
+    }
+    float bestcost = 1e30f, bestscale = 0;
+    int bestaxis = -1, bestbin = -1;
+    loopk(3)
+    {
+        if(cmax[k] - cmin[k] <= 0) continue;
+        int counts[BIHSAHBINS];
+        vec binmin[BIHSAHBINS], binmax[BIHSAHBINS];
+        loopj(BIHSAHBINS)
+        {
+            counts[j] = 0;
+            binmin[j] = vec(1e16f, 1e16f, 1e16f);
+            binmax[j] = vec(-1e16f, -1e16f, -1e16f);
+        }
+        float scale = BIHSAHBINS*0.999f/(cmax[k] - cmin[k]);
+        loopi(numindices)
+        {
+            tri &tri = tris[indices[i]];
+            int bin = int(((tri.a[k] + tri.b[k] + tri.c[k])/3 - cmin[k])*scale);
+            counts[bin]++;
+            binmin[bin].min(tri.a).min(tri.b).min(tri.c);
+            binmax[bin].max(tri.a).max(tri.b).max(tri.c);
+        }
+        float rightarea[BIHSAHBINS];
+        int rightcount[BIHSAHBINS];
+        vec rmin(1e16f, 1e16f, 1e16f), rmax(-1e16f, -1e16f, -1e16f);
+        int rcount = 0;
+        for(int j = BIHSAHBINS-1; j > 0; j--)
+        {
+            rcount += counts[j];
+            rmin.min(binmin[j]);
+            rmax.max(binmax[j]);
+            rightcount[j] = rcount;
+            rightarea[j] = rcount ? bihboxarea(rmin, rmax) : 0;
+        }
+        vec lmin(1e16f, 1e16f, 1e16f), lmax(-1e16f, -1e16f, -1e16f);
+        int lcount = 0;
+        for(int j = 1; j < BIHSAHBINS; j++)
+        {
+            lcount += counts[j-1];
+            lmin.min(binmin[j-1]);
+            lmax.max(binmax[j-1]);
+            if(!lcount || !rightcount[j]) continue;
+            float cost = lcount*bihboxarea(lmin, lmax) + rightcount[j]*rightarea[j];
+            if(cost < bestcost)
+            {
+                bestcost = cost;
+                bestaxis = k;
+                bestbin = j;
+                bestscale = scale;
+            }
+        }
+    }
+    if(bestaxis < 0) return 0;
+
+    int left = 0, right = numindices;
+    while(left < right)
+    {
+        tri &tri = tris[indices[left]];
+        int bin = int(((tri.a[bestaxis] + tri.b[bestaxis] + tri.c[bestaxis])/3 - cmin[bestaxis])*bestscale);
+        if(bin < bestbin) ++left;
+        else swap(indices[left], indices[--right]);
+    }
+    if(!left || left >= numindices) return 0;
+    axis = bestaxis;
+    return left;
+}
+
 void BIH::build(vector<BIHNode> &buildnodes, ushort *indices, int numindices, const vec &vmin, const vec &vmax, int depth)
 {
     maxdepth = max(maxdepth, depth);
@@ -137,8 +225,9 @@ void BIH::build(vector<BIHNode> &buildnodes, ushort *indices, int numindices, co
 
     vec leftmin, leftmax, rightmin, rightmax;
     float splitleft, splitright;
-    int left, right;
-    loopk(3)
+    int left = bihsah && numindices > 2 ? sahpartition(indices, numindices, axis) : 0, right = left;
+    bool partitioned = left > 0;
+    if(!partitioned) loopk(3)
     {
         leftmin = rightmin = vec(1e16f, 1e16f, 1e16f);
         leftmax = rightmax = vec(-1e16f, -1e16f, -1e16f);
@@ -168,11 +257,11 @@ void BIH::build(vector<BIHNode> &buildnodes, ushort *indices, int numindices, co
         axis = (axis+1)%3;
     }
 
-    if(!left || right==numindices) 
+    if(partitioned || !left || right==numindices) 
     {
         leftmin = rightmin = vec(1e16f, 1e16f, 1e16f);
         leftmax = rightmax = vec(-1e16f, -1e16f, -1e16f);
-        left = right = numindices/2;
+        if(!partitioned) left = right = numindices/2;
         splitleft = SHRT_MIN;
         splitright = SHRT_MAX;
         loopi(numindices)
@@ -234,7 +323,62 @@ BIH::BIH(vector<tri> *t)
     radius = max(max(max(fabs(bbmin.x), fabs(bbmin.y)), fabs(bbmin.z)),
                  max(max(fabs(bbmax.x), fabs(bbmax.y)), fabs(bbmax.z)));
     radius *= radius;
+}
+
+// nodes only refer to triangles by index, so a cached tree is reused for identical geometry
+bool BIH::cachekey(const char *name, string &key)
+{
+    if(!numtris || !name) return false;
+    uint crc = crc32(0, (const Bytef *)&numtris, sizeof(numtris));
+    crc = crc32(crc, (const Bytef *)&bihsah, sizeof(bihsah));
+    loopi(numtris) crc = crc32(crc, (const Bytef *)&tris[i].a, 3*sizeof(vec));
+    return modelcachekey("bih", name, NULL, crc, key);
+}
 
+bool BIH::loadnodes(const char *key)
+{
+    ucharbuf p;
+    uchar *buf = loadmodelcache(key, p);
+    if(!buf) return false;
+    int cachedepth = 0, cachenodes = 0;
+    p.get((uchar *)&cachedepth, sizeof(int));
+    p.get((uchar *)&cachenodes, sizeof(int));
+    bool loaded = !p.overread() && cachenodes > 0 && p.remaining() == cachenodes*int(sizeof(BIHNode));
+    if(loaded)
+    {
+        BIHNode *cached = new BIHNode[cachenodes];
+        p.get((uchar *)cached, cachenodes*sizeof(BIHNode));
+        loopi(cachenodes) loopj(2)
+        {
+            int child = cached[i].childindex(j);
+            if(child >= (cached[i].isleaf(j) ? numtris : cachenodes)) { loaded = false; break; }
+        }
+        if(loaded)
+        {
+            DELETEA(nodes);
+            nodes = cached;
+            numnodes = cachenodes;
+            maxdepth = cachedepth;
+        }
+        else delete[] cached;
+    }
+    delete[] buf;
+    return loaded;
+}
+
+void BIH::savenodes(const char *key)
+{
+    stream *f = savemodelcache(key);
+    if(!f) return;
+    f->write(&maxdepth, sizeof(int));
+    f->write(&numnodes, sizeof(int));
+    f->write(nodes, numnodes*sizeof(BIHNode));
+    delete f;
+}
+
+// touches nothing but this BIH, so it may run on a worker thread
+void BIH::gennodes()
+{
     vector<BIHNode> buildnodes;
     ushort *indices = new ushort[numtris];
     loopi(numtris) indices[i] = i;
@@ -245,10 +389,14 @@ BIH::BIH(vector<tri> *t)
 
     delete[] indices;
 
+    DELETEA(nodes);
     numnodes = buildnodes.length();
     nodes = new BIHNode[numnodes];
     memcpy(nodes, buildnodes.getbuf(), numnodes*sizeof(BIHNode));
+}
 
+void BIH::finishnodes()
+{
     // convert tri.b/tri.c to edges
     loopi(numtris)
     {
@@ -258,6 +406,29 @@ BIH::BIH(vector<tri> *t)
     }
 }
 
+void BIH::buildnodes(const char *key)
+{
+    if(!numtris) return;
+    if(!key || !loadnodes(key))
+    {
+        gennodes();
+        if(key) savenodes(key);
+    }
+    finishnodes();
+}
+
+void BIH::rebuild()
+{
+    if(!numtris) return;
+    loopi(numtris)
+    {
+        tri &tri = tris[i];
+        tri.b.add(tri.a);
+        tri.c.add(tri.a);
+    }
+    buildnodes();
+}
+
 bool mmintersect(const extentity &e, const vec &o, const vec &ray, float maxdist, int mode, float &dist)
 {
     extern vector<mapmodelinfo> mapmodels;
@@ -289,3 +460,53 @@ bool mmintersect(const extentity &e, const vec &o, const vec &ray, float maxdist
     return m->bih->traverse(mo, mray, maxdist ? maxdist : 1e16f, dist, mode);
 }
 
+
+void bihbench(int *numrays)
+{
+    extern vector<mapmodelinfo> mapmodels;
+    int raysper = *numrays > 0 ? *numrays : 100000, models = 0, oldsah = bihsah;
+    Uint32 millis[2] = { 0, 0 };
+    int nodes[2] = { 0, 0 }, depth[2] = { 0, 0 }, hits[2] = { 0, 0 };
+    vector<vec> rays;
+    loopv(mapmodels)
+    {
+        model *m = mapmodels[i].m;
+        if(!m || (!m->bih && !m->setBIH())) continue;
+        BIH *bih = m->bih;
+        if(!bih->numnodes) continue;
+        models++;
+        rays.setsize(0);
+        vec center = vec(bih->bbmin).add(bih->bbmax).mul(0.5f), extent = vec(bih->bbmax).sub(bih->bbmin);
+        float r = max(sqrtf(bih->radius), 1.0f);
+        loopj(raysper)
+        {
+            vec o(rndscale(2) - 1, rndscale(2) - 1, rndscale(2) - 1), target(rndscale(1), rndscale(1), rndscale(1));
+            if(o.iszero()) o.z = 1;
+            o.normalize().mul(2*r).add(center);
+            target.mul(extent).add(bih->bbmin);
+            rays.add(o);
+            rays.add(target.sub(o).normalize());
+        }
+        loopk(2)
+        {
+            bihsah = k;
+            bih->rebuild();
+            nodes[k] += bih->numnodes;
+            depth[k] = max(depth[k], bih->maxdepth);
+            Uint32 start = SDL_GetTicks();
+            for(int j = 0; j < rays.length(); j += 2)
+            {
+                float dist;
+                if(bih->traverse(rays[j], rays[j+1], 4*r, dist, RAY_SHADOW)) hits[k]++;
+            }
+            millis[k] += SDL_GetTicks() - start;
+        }
+        if(bihsah != oldsah) { bihsah = oldsah; bih->rebuild(); }
+    }
+    bihsah = oldsah;
+    if(!models) { conoutf("no mapmodels loaded"); return; }
+    static const char * const names[2] = { "midpoint", "sah" };
+    loopk(2) conoutf("%s: %d nodes, max depth %d, %d hits, %.0f rays/sec", names[k], nodes[k], depth[k], hits[k], models*raysper*1000.0f/max(millis[k], Uint32(1)));
+}
+
+COMMAND(bihbench, "i");
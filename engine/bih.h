@@ -35,7 +35,15 @@ struct BIH
 
     static bool triintersect(tri &t, const vec &o, const vec &ray, float maxdist, float &dist, int mode, tri *noclip);
 
+    int sahpartition(ushort *indices, int numindices, int &axis);
     void build(vector<BIHNode> &buildnodes, ushort *indices, int numindices, const vec &vmin, const vec &vmax, int depth = 1);
+    bool cachekey(const char *name, string &key);
+    bool loadnodes(const char *key);
+    void savenodes(const char *key);
+    void gennodes();
+    void finishnodes();
+    void buildnodes(const char *key = NULL);
+    void rebuild();
 
     bool traverse(const vec &o, const vec &ray, float maxdist, float &dist, int mode);
     bool traverse(const vec &o, const vec &ray, const vec &invray, float maxdist, float &dist, int mode, BIHNode *curnode, float tmin, float tmax);
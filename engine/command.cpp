@@ -3,6 +3,10 @@
 
 #include "engine.h"
 
+#ifndef WIN32
+#include <sys/time.h>
+#endif
+
 hashset<ident> idents; // contains ALL vars/commands/aliases
 vector<ident *> identmap;
 ident *dummyident = NULL;
@@ -270,7 +274,7 @@ static void debugalias()
     }
 }
 
-static int nodebug = 0;
+static int nodebug = 0, compileerrors = 0;
 
 static void debugcode(const char *fmt, ...) PRINTFARGS(1, 2);
 
@@ -290,6 +294,7 @@ static void debugcodeline(const char *p, const char *fmt, ...) PRINTFARGS(2, 3);
 
 static void debugcodeline(const char *p, const char *fmt, ...)
 {
+    compileerrors++;
     if(nodebug) return;
 
     va_list args;
@@ -1456,6 +1461,135 @@ void freecode(uint *code)
     }
 }
 
+// compiled code for strings run through the string entry points, so repeated binds, sleeps and menu actions skip parsing
+// words that named no ident when compiled become lookups by name, so only code holding those is dropped when new idents appear
+
+#define MAXCODECACHELEN 4096
+
+struct codecacheentry
+{
+    char *str;
+    uint *code;
+    bool byname;
+    codecacheentry *prev, *next, *prevbyname, *nextbyname;
+};
+
+static hashtable<const char *, codecacheentry> codecache;
+static codecacheentry *codecachehead = NULL, *codecachetail = NULL, *codecachebyname = NULL;
+static int codecacheidents = 0, codecachehits = 0, codecachemisses = 0;
+
+static bool hasbynamelookups(const uint *code, int len)
+{
+    const uint *end = code + len;
+    while(code < end)
+    {
+        uint op = *code++;
+        switch(op&0xFF)
+        {
+            case CODE_MACRO:
+            case CODE_VAL|RET_STR:
+                code += (op>>8)/sizeof(uint) + 1;
+                continue;
+            case CODE_VAL|RET_INT:
+            case CODE_VAL|RET_FLOAT:
+                code++;
+                continue;
+        }
+        switch(op&CODE_OP_MASK)
+        {
+            case CODE_IDENTU: case CODE_LOOKUPU: case CODE_ALIASU: case CODE_CALLU:
+                return true;
+        }
+    }
+    return false;
+}
+
+static inline void unlinkcodecache(codecacheentry *e)
+{
+    if(e->prev) e->prev->next = e->next; else codecachehead = e->next;
+    if(e->next) e->next->prev = e->prev; else codecachetail = e->prev;
+}
+
+static inline void linkcodecache(codecacheentry *e)
+{
+    e->prev = NULL;
+    e->next = codecachehead;
+    if(codecachehead) codecachehead->prev = e; else codecachetail = e;
+    codecachehead = e;
+}
+
+static void removecodecache(codecacheentry *e)
+{
+    unlinkcodecache(e);
+    if(e->byname)
+    {
+        if(e->prevbyname) e->prevbyname->nextbyname = e->nextbyname; else codecachebyname = e->nextbyname;
+        if(e->nextbyname) e->nextbyname->prevbyname = e->prevbyname;
+    }
+    char *str = e->str;
+    freecode(e->code);
+    codecache.remove(str);
+    delete[] str;
+}
+
+void clearcodecache()
+{
+    enumerate(codecache, codecacheentry, e, { freecode(e.code); delete[] e.str; });
+    codecache.clear();
+    codecachehead = codecachetail = codecachebyname = NULL;
+}
+
+VARF(codecachesize, 0, 256, 4096, clearcodecache());
+
+static uint *getcachedcode(const char *p)
+{
+    if(codecachesize <= 0 || strlen(p) >= MAXCODECACHELEN) return NULL;
+    if(codecacheidents != idents.numelems)
+    {
+        while(codecachebyname) removecodecache(codecachebyname);
+        codecacheidents = idents.numelems;
+    }
+    codecacheentry *e = codecache.access(p);
+    if(e)
+    {
+        codecachehits++;
+        unlinkcodecache(e);
+    }
+    else
+    {
+        codecachemisses++;
+        while(codecachetail && codecache.numelems >= codecachesize) removecodecache(codecachetail);
+        vector<uint> buf;
+        buf.reserve(64);
+        compilemain(buf, p);
+        uint *code = new uint[buf.length()];
+        memcpy(code, buf.getbuf(), buf.length()*sizeof(uint));
+        code[0] += 0x100;
+        char *str = newstring(p);
+        e = &codecache[str];
+        e->str = str;
+        e->code = code;
+        e->byname = hasbynamelookups(buf.getbuf(), buf.length());
+        if(e->byname)
+        {
+            e->prevbyname = NULL;
+            e->nextbyname = codecachebyname;
+            if(codecachebyname) codecachebyname->prevbyname = e;
+            codecachebyname = e;
+        }
+    }
+    linkcodecache(e);
+    keepcode(e->code);
+    return e->code;
+}
+
+void codecachestats()
+{
+    int lookups = codecachehits + codecachemisses;
+    conoutf("code cache: %d entries, %d hits, %d misses (%.1f%% hit rate)", codecache.numelems, codecachehits, codecachemisses, lookups ? codecachehits*100.0f/lookups : 0.0f);
+}
+COMMAND(codecachestats, "");
+
 void printvar(ident *id, int i)
 {
     if(i < 0) conoutf("%s = %d", id->name, i);
@@ -1532,10 +1666,165 @@ static const uint *skipcode(const uint *code, tagval &result)
     }
 }
 
+// script profiler: call counts, inclusive/exclusive time and heap allocations per alias and command
+// allocations are sampled from the global counter, so other threads running at the same time are included
+
+struct scriptprofentry
+{
+    int calls, active;
+    llong inclusive, exclusive;
+    uint allocs;
+};
+
+struct scriptprofframe
+{
+    ident *id;
+    llong start, child;
+    uint allocs, childallocs;
+};
+
+static vector<scriptprofentry> scriptprofs;
+static vector<scriptprofframe> scriptprofstack;
+static llong scriptprofstart = 0;
+
+static llong scriptproftime()
+{
+#ifdef WIN32
+    static LARGE_INTEGER freq = { 0 };
+    if(!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return llong(double(t.QuadPart)*1e6/double(freq.QuadPart));
+#else
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return llong(t.tv_sec)*1000000 + t.tv_usec;
+#endif
+}
+
+static void resetscriptprof()
+{
+    loopv(scriptprofs)
+    {
+        scriptprofentry &e = scriptprofs[i];
+        e.calls = 0;
+        e.inclusive = e.exclusive = 0;
+        e.allocs = 0;
+    }
+    scriptprofstart = scriptproftime();
+}
+
+VARF(scriptprofile, 0, 0, 1, { countallocs = scriptprofile != 0; if(scriptprofile) resetscriptprof(); });
+
+static void enterscriptprof(ident *id)
+{
+    while(scriptprofs.length() <= id->index)
+    {
+        scriptprofentry &e = scriptprofs.add();
+        memset(&e, 0, sizeof(e));
+    }
+    scriptprofs[id->index].active++;
+    scriptprofframe &f = scriptprofstack.add();
+    f.id = id;
+    f.child = 0;
+    f.allocs = numallocs;
+    f.childallocs = 0;
+    f.start = scriptproftime();
+}
+
+static void leavescriptprof()
+{
+    llong elapsed = scriptproftime();
+    uint allocs = numallocs;
+    scriptprofframe f = scriptprofstack.pop();
+    elapsed -= f.start;
+    allocs -= f.allocs;
+    scriptprofentry &e = scriptprofs[f.id->index];
+    e.calls++;
+    if(!--e.active) e.inclusive += elapsed;
+    e.exclusive += elapsed - f.child;
+    e.allocs += allocs - f.childallocs;
+    if(scriptprofstack.length())
+    {
+        scriptprofframe &parent = scriptprofstack.last();
+        parent.child += elapsed;
+        parent.childallocs += allocs;
+    }
+}
+
+#define PROFILECALL(id, body) \
+    { \
+        bool profiled = scriptprofile != 0; \
+        if(profiled) enterscriptprof(id); \
+        body; \
+        if(profiled) leavescriptprof(); \
+    }
+
+static int scriptprofsort = 0;
+
+static bool sortscriptprof(ident *x, ident *y)
+{
+    const scriptprofentry &a = scriptprofs[x->index], &b = scriptprofs[y->index];
+    switch(scriptprofsort)
+    {
+        case 1: if(a.inclusive != b.inclusive) return a.inclusive > b.inclusive; break;
+        case 2: if(a.calls != b.calls) return a.calls > b.calls; break;
+        case 3: if(a.allocs != b.allocs) return a.allocs > b.allocs; break;
+        default: if(a.exclusive != b.exclusive) return a.exclusive > b.exclusive; break;
+    }
+    return strcmp(x->name, y->name) < 0;
+}
+
+static void getscriptprof(vector<ident *> &ids, const char *sort)
+{
+    if(!strcmp(sort, "incl")) scriptprofsort = 1;
+    else if(!strcmp(sort, "calls")) scriptprofsort = 2;
+    else if(!strcmp(sort, "allocs")) scriptprofsort = 3;
+    else scriptprofsort = 0;
+    loopv(scriptprofs) if(scriptprofs[i].calls && identmap.inrange(i)) ids.add(identmap[i]);
+    ids.sort(sortscriptprof);
+}
+
+void showscriptprof(const char *sort, int num)
+{
+    vector<ident *> ids;
+    getscriptprof(ids, sort);
+    if(num <= 0) num = 10;
+    conoutf("script profile over %.1f seconds (%s, %d entries):", (scriptproftime() - scriptprofstart)/1e6, scriptprofile ? "running" : "stopped", ids.length());
+    conoutf("     calls    incl ms    excl ms    allocs  name");
+    loopv(ids)
+    {
+        if(i >= num) break;
+        const scriptprofentry &e = scriptprofs[ids[i]->index];
+        conoutf("%10d %10.2f %10.2f %9u  %s%s", e.calls, e.inclusive/1e3, e.exclusive/1e3, e.allocs, ids[i]->name, ids[i]->type == ID_ALIAS ? "" : " (command)");
+    }
+}
+ICOMMAND(scriptprof, "si", (char *sort, int *num), showscriptprof(sort, *num));
+
+void dumpscriptprof(const char *name)
+{
+    if(!name[0]) name = "scriptprof.txt";
+    stream *f = openutf8file(path(name, true), "w");
+    if(!f) { conoutf(CON_ERROR, "could not write script profile to %s", name); return; }
+    vector<ident *> ids;
+    getscriptprof(ids, "");
+    f->printf("// script profile over %.1f seconds\n// calls\tinclusive ms\texclusive ms\tallocs\ttype\tname\n", (scriptproftime() - scriptprofstart)/1e6);
+    loopv(ids)
+    {
+        const scriptprofentry &e = scriptprofs[ids[i]->index];
+        f->printf("%d\t%.3f\t%.3f\t%u\t%s\t%s\n", e.calls, e.inclusive/1e3, e.exclusive/1e3, e.allocs, ids[i]->type == ID_ALIAS ? "alias" : "command", ids[i]->name);
+    }
+    delete f;
+    conoutf("wrote script profile to %s", name);
+}
+ICOMMAND(scriptprofdump, "s", (char *name), dumpscriptprof(name));
+ICOMMAND(scriptprofreset, "", (), resetscriptprof());
+
 static inline void callcommand(ident *id, tagval *args, int numargs, bool lookup = false)
 {
     int i = -1, fakeargs = 0;
-    bool rep = false;
+    bool rep = false, profiled = scriptprofile != 0;
+    if(profiled) enterscriptprof(id);
     for(const char *fmt = id->args; *fmt; fmt++) switch(*fmt)
     {
         case 'i': if(++i >= numargs) { if(rep) break; args[i].setint(0); fakeargs++; } else forceint(args[i]); break;
@@ -1588,6 +1877,7 @@ static inline void callcommand(ident *id, tagval *args, int numargs, bool lookup
     ++i;
     CALLCOM(i)
 cleanup:
+    if(profiled) leavescriptprof();
     loopk(i) freearg(args[k]);
     for(; i < numargs; i++) freearg(args[i]);
 }
@@ -1838,7 +2128,7 @@ static const uint *runcode(const uint *code, tagval &result)
             callcom:
 #endif
                 forcenull(result);
-                CALLCOM(numargs) 
+                PROFILECALL(id, CALLCOM(numargs));
             forceresult:
                 freeargs(args, numargs, 0);
                 forcearg(result, op&CODE_RET_MASK);
@@ -1853,14 +2143,14 @@ static const uint *runcode(const uint *code, tagval &result)
             case CODE_COMV|RET_NULL: case CODE_COMV|RET_STR: case CODE_COMV|RET_FLOAT: case CODE_COMV|RET_INT:
                 id = identmap[op>>8];
                 forcenull(result);
-                ((comfunv)id->fun)(args, numargs);
+                PROFILECALL(id, ((comfunv)id->fun)(args, numargs));
                 goto forceresult; 
             case CODE_COMC|RET_NULL: case CODE_COMC|RET_STR: case CODE_COMC|RET_FLOAT: case CODE_COMC|RET_INT:
                 id = identmap[op>>8];
                 forcenull(result);
                 {
                     vector<char> buf;
-                    ((comfun1)id->fun)(conc(buf, args, numargs, true));
+                    PROFILECALL(id, ((comfun1)id->fun)(conc(buf, args, numargs, true)));
                 }
                 goto forceresult;
 
@@ -1913,7 +2203,7 @@ static const uint *runcode(const uint *code, tagval &result)
                     if(!id->code) id->code = compilecode(id->getstr()); \
                     uint *code = id->code; \
                     code[0] += 0x100; \
-                    runcode(code+1, result); \
+                    PROFILECALL(id, runcode(code+1, result)); \
                     code[0] -= 0x100; \
                     if(int(code[0]) < 0x100) delete[] code; \
                     aliasstack = aliaslink.next; \
@@ -2012,15 +2302,27 @@ void executeret(const uint *code, tagval &result)
     runcode(code, result); 
 }
 
-void executeret(const char *p, tagval &result)
+static void executeret(const char *p, tagval &result, int rettype, bool cache)
 {
+    uint *cached = cache ? getcachedcode(p) : NULL;
+    if(cached)
+    {
+        runcode(cached+1, result);
+        freecode(cached);
+        return;
+    }
     vector<uint> code;
     code.reserve(64);
-    compilemain(code, p, VAL_ANY);
+    compilemain(code, p, rettype);
     runcode(code.getbuf()+1, result);
     if(int(code[0]) >= 0x100) code.disown();
 }
 
+void executeret(const char *p, tagval &result)
+{
+    executeret(p, result, VAL_ANY, true);
+}
+
 char *executestr(const uint *code)
 {
     tagval result;
@@ -2050,12 +2352,8 @@ int execute(const uint *code)
 
 int execute(const char *p)
 {
-    vector<uint> code;
-    code.reserve(64);
-    compilemain(code, p, VAL_INT);
     tagval result;
-    runcode(code.getbuf()+1, result);
-    if(int(code[0]) >= 0x100) code.disown();
+    executeret(p, result, VAL_INT, true);
     int i = result.getint();
     freearg(result);
     return i;
@@ -2119,11 +2417,174 @@ bool executebool(const char *p)
     return b;
 }
 
+// compiled bytecode of exec'd files is kept under cache/script, keyed by path, size and crc of the source
+// ident operands are stored as indexes into a name table and relocated against the current idents on load
+
+#define SCRIPTCACHEMAGIC 0x31435343 // "CSC1" in native byte order
+#define SCRIPTCACHEVERSION 1 // bump whenever the meaning of an opcode changes
+
+VAR(scriptcache, 0, 1, 1);
+
+struct scriptcacheheader
+{
+    uint magic, version, numcodes, maxargs, srclen, srccrc, pathlen, numnames, namesize, codelen;
+};
+
+static const char *scriptcachename(const char *cfgfile)
+{
+    static string name;
+    copystring(name, "cache/script/");
+    int len = strlen(name);
+    for(const char *s = cfgfile; *s && len + 5 < MAXSTRLEN; s++) name[len++] = isalnum(*s) || *s == '.' || *s == '-' ? *s : '_';
+    copystring(&name[len], ".csc", MAXSTRLEN - len);
+    return name;
+}
+
+static inline bool hasidentoperand(uint op)
+{
+    switch(op&CODE_OP_MASK)
+    {
+        case CODE_IDENT: case CODE_IDENTARG:
+        case CODE_COM: case CODE_COMD: case CODE_COMC: case CODE_COMV:
+        case CODE_SVAR: case CODE_SVAR1:
+        case CODE_IVAR: case CODE_IVAR1: case CODE_IVAR2: case CODE_IVAR3:
+        case CODE_FVAR: case CODE_FVAR1:
+        case CODE_LOOKUP: case CODE_LOOKUPARG:
+        case CODE_ALIAS: case CODE_ALIASARG:
+        case CODE_CALL: case CODE_CALLARG:
+        case CODE_PRINT:
+            return true;
+    }
+    return false;
+}
+
+// rewrites ident operands through remap, or builds remap and the list of used idents when saving
+static bool relocatecode(uint *code, int len, vector<int> &remap, vector<ident *> *used = NULL)
+{
+    uint *end = code + len;
+    while(code < end)
+    {
+        uint op = *code++;
+        switch(op&0xFF)
+        {
+            case CODE_MACRO:
+            case CODE_VAL|RET_STR:
+                code += (op>>8)/sizeof(uint) + 1;
+                continue;
+            case CODE_VAL|RET_INT:
+            case CODE_VAL|RET_FLOAT:
+                code++;
+                continue;
+        }
+        if(!hasidentoperand(op)) continue;
+        int idx = int(op>>8);
+        if(!remap.inrange(idx)) return false;
+        if(used && remap[idx] < 0)
+        {
+            remap[idx] = used->length();
+            used->add(identmap[idx]);
+        }
+        code[-1] = (op&0xFF)|(uint(remap[idx])<<8);
+    }
+    return code == end;
+}
+
+static void savescriptcache(const char *cfgfile, int srclen, uint srccrc, const uint *code, int codelen)
+{
+    vector<uint> buf;
+    buf.put(code, codelen);
+    buf[0] = CODE_START;
+    vector<int> remap;
+    loopv(identmap) remap.add(-1);
+    vector<ident *> used;
+    if(!relocatecode(buf.getbuf(), buf.length(), remap, &used)) return;
+
+    vector<char> names;
+    loopv(used)
+    {
+        ident *id = used[i];
+        names.add(char(id->type));
+        names.add(char(id->flags&IDF_HEX));
+        names.put(id->name, strlen(id->name)+1);
+        const char *args = id->type == ID_COMMAND ? id->args : "";
+        names.put(args, strlen(args)+1);
+    }
+
+    if(!createcachedir("script")) return;
+    stream *f = openrawfile(path(scriptcachename(cfgfile), true), "wb");
+    if(!f) return;
+    scriptcacheheader hdr = { SCRIPTCACHEMAGIC, SCRIPTCACHEVERSION, NUMCODES, MAXARGS, uint(srclen), srccrc, uint(strlen(cfgfile)), uint(used.length()), uint(names.length()), uint(buf.length()) };
+    f->write(&hdr, sizeof(hdr));
+    f->write(cfgfile, hdr.pathlen);
+    f->write(names.getbuf(), names.length());
+    f->write(buf.getbuf(), buf.length()*sizeof(uint));
+    delete f;
+}
+
+static ident *resolvescriptident(int type, int flags, const char *name, const char *args)
+{
+    ident *id = idents.access(name);
+    if(type == ID_ALIAS)
+    {
+        if(!id) id = newident(name, IDF_UNKNOWN);
+        return id->type == ID_ALIAS ? id : NULL;
+    }
+    if(!id || id->type != type || (id->flags&IDF_HEX) != flags) return NULL;
+    if(type == ID_COMMAND && strcmp(id->args, args)) return NULL;
+    return id;
+}
+
+static uint *loadscriptcache(const char *cfgfile, int srclen, uint srccrc)
+{
+    int len = 0;
+    char *buf = loadfile(path(scriptcachename(cfgfile), true), &len, false);
+    if(!buf) return NULL;
+    scriptcacheheader hdr;
+    uint pathlen = strlen(cfgfile);
+    if(len < int(sizeof(hdr))) { delete[] buf; return NULL; }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if(hdr.magic != SCRIPTCACHEMAGIC || hdr.version != SCRIPTCACHEVERSION || hdr.numcodes != NUMCODES || hdr.maxargs != MAXARGS ||
+       hdr.srclen != uint(srclen) || hdr.srccrc != srccrc || hdr.pathlen != pathlen || !hdr.codelen ||
+       sizeof(hdr) + pathlen + hdr.namesize + hdr.codelen*sizeof(uint) != uint(len) ||
+       memcmp(buf + sizeof(hdr), cfgfile, pathlen))
+    {
+        delete[] buf;
+        return NULL;
+    }
+
+    vector<int> remap;
+    const char *names = buf + sizeof(hdr) + pathlen, *namesend = names + hdr.namesize;
+    while(names + 2 < namesend && remap.length() < int(hdr.numnames))
+    {
+        int type = uchar(names[0]), flags = uchar(names[1]);
+        const char *name = names + 2, *nameend = (const char *)memchr(name, '\0', namesend - name);
+        if(!nameend) break;
+        const char *args = nameend + 1, *argsend = args < namesend ? (const char *)memchr(args, '\0', namesend - args) : NULL;
+        if(!argsend) break;
+        ident *id = resolvescriptident(type, flags, name, args);
+        if(!id) break;
+        remap.add(id->index);
+        names = argsend + 1;
+    }
+
+    uint *code = NULL;
+    if(names == namesend && remap.length() == int(hdr.numnames))
+    {
+        code = new uint[hdr.codelen];
+        memcpy(code, namesend, hdr.codelen*sizeof(uint));
+        if(relocatecode(code, hdr.codelen, remap) && code[0] == CODE_START) code[0] += 0x100;
+        else DELETEA(code);
+    }
+    delete[] buf;
+    return code;
+}
+
 bool execfile(const char *cfgfile, bool msg)
 {
     string s;
     copystring(s, cfgfile);
-    char *buf = loadfile(path(s), NULL);
+    int len = 0;
+    char *buf = loadfile(path(s), &len);
     if(!buf)
     {
         if(msg) conoutf(CON_ERROR, "could not read \"%s\"", cfgfile);
@@ -2132,7 +2593,27 @@ bool execfile(const char *cfgfile, bool msg)
     const char *oldsourcefile = sourcefile, *oldsourcestr = sourcestr;
     sourcefile = cfgfile;
     sourcestr = buf;
-    execute(buf);
+    tagval result;
+    if(scriptcache)
+    {
+        uint crc = crc32(0, (const Bytef *)buf, len);
+        uint *code = loadscriptcache(cfgfile, len, crc);
+        if(!code)
+        {
+            vector<uint> compiled;
+            compiled.reserve(64);
+            int errors = compileerrors;
+            compilemain(compiled, buf);
+            if(compileerrors == errors) savescriptcache(cfgfile, len, crc, compiled.getbuf(), compiled.length());
+            code = new uint[compiled.length()];
+            memcpy(code, compiled.getbuf(), compiled.length()*sizeof(uint));
+            code[0] += 0x100;
+        }
+        runcode(code+1, result);
+        freecode(code);
+    }
+    else executeret(buf, result, VAL_ANY, false);
+    freearg(result);
     sourcefile = oldsourcefile;
     sourcestr = oldsourcestr;
     delete[] buf;
@@ -2443,6 +2924,79 @@ static bool parselist(const char *&s, const char *&start = liststart, const char
     return true;
 }
      
+struct listelem
+{
+    int start, end, quotestart, quoteend;
+};
+
+struct parsedlist
+{
+    char *str;
+    int len, tail;
+    uint lastused;
+    vector<listelem> elems;
+
+    parsedlist() : str(NULL), len(0), tail(0), lastused(0) {}
+};
+
+// element offsets of recently used lists, so indexing idioms like "loop i (listlen $l) [at $l $i]" find an element
+// by offset instead of reparsing up to it; a hit still compares the whole string, so each call stays linear in its length
+#define MAXPARSEDLISTS 8
+#define MAXPARSEDLISTLEN (64*1024)
+static parsedlist parsedlists[MAXPARSEDLISTS], uncachedlists[2];
+static uint parsedlistuses = 0;
+static int uncachedlist = 0;
+
+static void parselistelems(parsedlist &l)
+{
+    l.elems.setsize(0);
+    const char *p = l.str, *start, *end, *quotestart, *quoteend;
+    while(parselist(p, start, end, quotestart, quoteend))
+    {
+        listelem &e = l.elems.add();
+        e.start = start - l.str;
+        e.end = end - l.str;
+        e.quotestart = quotestart - l.str;
+        e.quoteend = quoteend - l.str;
+    }
+    l.tail = p - l.str;
+}
+
+// lists too long to keep a copy of are parsed in place and only valid until the command returns
+static const parsedlist &getuncachedlist(const char *s, int len)
+{
+    parsedlist &l = uncachedlists[uncachedlist];
+    uncachedlist = (uncachedlist + 1) % 2;
+    l.str = (char *)s;
+    l.len = len;
+    parselistelems(l);
+    return l;
+}
+
+static const parsedlist &getparsedlist(const char *s)
+{
+    int len = strlen(s);
+    if(len > MAXPARSEDLISTLEN) return getuncachedlist(s, len);
+    parsedlist *oldest = &parsedlists[0];
+    loopi(MAXPARSEDLISTS)
+    {
+        parsedlist &l = parsedlists[i];
+        if(l.str && l.len == len && !memcmp(l.str, s, len))
+        {
+            l.lastused = ++parsedlistuses;
+            return l;
+        }
+        if(l.lastused < oldest->lastused) oldest = &l;
+    }
+    parsedlist &l = *oldest;
+    DELETEA(l.str);
+    l.str = newstring(s, len);
+    l.len = len;
+    l.lastused = ++parsedlistuses;
+    parselistelems(l);
+    return l;
+}
+
 void explodelist(const char *s, vector<char *> &elems, int limit)
 {
     const char *start, *end;
@@ -2452,23 +3006,35 @@ void explodelist(const char *s, vector<char *> &elems, int limit)
 
 char *indexlist(const char *s, int pos)
 {
-    loopi(pos) if(!parselist(s)) return newstring("");
-    const char *start, *end;
-    return parselist(s, start, end) ? newstring(start, end-start) : newstring("");
+    const parsedlist &l = getparsedlist(s);
+    pos = max(pos, 0);
+    if(!l.elems.inrange(pos)) return newstring("");
+    const listelem &e = l.elems[pos];
+    return newstring(&s[e.start], e.end-e.start);
 }
 
 int listlen(const char *s)
 {
-    int n = 0;
-    while(parselist(s)) n++;
-    return n;
+    return getparsedlist(s).elems.length();
 }
 
 void at(tagval *args, int numargs)
 {
     if(!numargs) return;
     const char *start = args[0].getstr(), *end = start + strlen(start);
-    for(int i = 1; i < numargs; i++)
+    if(numargs > 1)
+    {
+        const parsedlist &l = getparsedlist(start);
+        int pos = max(args[1].getint(), 0);
+        if(!l.elems.inrange(pos)) start = end = "";
+        else
+        {
+            const listelem &e = l.elems[pos];
+            end = start + e.end;
+            start += e.start;
+        }
+    }
+    for(int i = 2; i < numargs; i++)
     {
         const char *list = start;
         int pos = args[i].getint();
@@ -2487,11 +3053,17 @@ void substr(char *s, int *start, int *count, int *numargs)
 void sublist(const char *s, int *skip, int *count, int *numargs)
 {
     int offset = max(*skip, 0), len = *numargs >= 3 ? max(*count, 0) : -1;
-    loopi(offset) if(!parselist(s)) break;
-    if(len < 0) { if(offset > 0) skiplist(s); commandret->setstr(newstring(s)); return; }
-    const char *list = s, *start, *end, *qstart, *qend = s;
-    if(len > 0 && parselist(s, start, end, list, qend)) while(--len > 0 && parselist(s, start, end, qstart, qend));
-    commandret->setstr(newstring(list, qend - list)); 
+    const parsedlist &l = getparsedlist(s);
+    int numelems = l.elems.length();
+    if(len < 0) 
+    {
+        int pos = !offset ? 0 : (offset < numelems ? l.elems[offset].quotestart : l.tail);
+        commandret->setstr(newstring(&s[pos], l.len - pos)); 
+        return; 
+    }
+    if(!len || offset >= numelems) { commandret->setstr(newstring("")); return; }
+    int qstart = l.elems[offset].quotestart, qend = l.elems[min(offset + len, numelems) - 1].quoteend;
+    commandret->setstr(newstring(&s[qstart], qend - qstart)); 
 }
 
 void getalias_(char *s)
@@ -2585,24 +3157,28 @@ void prettylist(const char *s, const char *conj)
 }
 COMMAND(prettylist, "ss");
 
-int listincludes(const char *list, const char *needle, int needlelen)
+static int listincludes(const parsedlist &l, const char *needle, int needlelen)
 {
-    int offset = 0;
-    for(const char *s = list, *start, *end; parselist(s, start, end);)
+    loopv(l.elems)
     {
-        int len = end - start;
-        if(needlelen == len && !strncmp(needle, start, len)) return offset;
-        offset++;
+        const listelem &e = l.elems[i];
+        if(needlelen == e.end - e.start && !strncmp(needle, &l.str[e.start], needlelen)) return i;
     }
     return -1;
 }
+
+int listincludes(const char *list, const char *needle, int needlelen)
+{
+    return listincludes(getparsedlist(list), needle, needlelen);
+}
     
 char *listdel(const char *s, const char *del)
 {
+    const parsedlist &dl = getparsedlist(del);
     vector<char> p;
     for(const char *start, *end, *qstart, *qend; parselist(s, start, end, qstart, qend);)
     {
-        if(listincludes(del, start, end-start) < 0)
+        if(listincludes(dl, start, end-start) < 0)
         {
             if(!p.empty()) p.add(' ');
             p.put(qstart, qend-qstart);
@@ -2615,24 +3191,19 @@ char *listdel(const char *s, const char *del)
 void listsplice(const char *s, const char *vals, int *skip, int *count, int *numargs)
 {
     int offset = max(*skip, 0), len = *numargs >= 4 ? max(*count, 0) : -1;
-    const char *list = s, *start, *end, *qstart, *qend = s;
-    loopi(offset) if(!parselist(s, start, end, qstart, qend)) break;
+    const parsedlist &l = getparsedlist(s);
+    int numelems = l.elems.length(), next = min(offset + max(len, 0), numelems);
     vector<char> p;
-    if(qend > list) p.put(list, qend-list);
+    if(offset > 0 && numelems > 0) p.put(s, l.elems[min(offset, numelems) - 1].quoteend);
     if(*vals)
     {
         if(!p.empty()) p.add(' ');
         p.put(vals, strlen(vals));
     }
-    while(len-- > 0) if(!parselist(s)) break;
-    skiplist(s);
-    switch(*s)
+    if(next < numelems)
     {
-        case '\0': case ')': case ']': break;
-        default:
-            if(!p.empty()) p.add(' ');
-            p.put(s, strlen(s));
-            break;
+        if(!p.empty()) p.add(' ');
+        p.put(&s[l.elems[next].quotestart], l.len - l.elems[next].quotestart);
     }
     p.add('\0');
     commandret->setstr(newstring(p.getbuf(), p.length()-1));
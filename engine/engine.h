@@ -159,6 +159,10 @@ extern font *curfont;
 extern int hwtexsize, hwcubetexsize, hwmaxaniso, maxtexsize;
 
 extern Texture *textureload(const char *name, int clamp = 0, bool mipit = true, bool msg = true);
+extern Texture *asynctextureload(const char *name, int clamp = 0, bool mipit = true);
+extern void flushasynctextures();
+extern void prefetchtextures(const vector<int> &texs);
+extern void finishprefetchtextures();
 extern int texalign(void *data, int w, int bpp);
 extern void cleanuptexture(Texture *t);
 extern void loadalphamask(Texture *t);
@@ -206,6 +210,7 @@ extern void clearpvs();
 extern bool pvsoccluded(const ivec &bborigin, const ivec &bbsize);
 extern bool waterpvsoccluded(int height);
 extern void setviewcell(const vec &p);
+extern void pvschanged(const ivec &bborigin, const ivec &bbsize);
 extern void savepvs(stream *f);
 extern void loadpvs(stream *f, int numpvs);
 extern int getnumviewcells();
@@ -542,7 +547,11 @@ struct ShadowRayCache;
 extern ShadowRayCache *newshadowraycache();
 extern void freeshadowraycache(ShadowRayCache *&cache);
 extern void resetshadowraycache(ShadowRayCache *cache);
+extern void getshadowraycachestats(ShadowRayCache *cache, uint &hits, uint &lookups);
 extern float shadowray(ShadowRayCache *cache, const vec &o, const vec &ray, float radius, int mode, extentity *t = NULL);
+extern void flushlos();
+#define SHADOWRAYPACKET 4
+extern void shadowrays(ShadowRayCache *cache, const vec *o, const vec *ray, const float *radius, float *dist, int mode, int lanes, extentity *t = NULL);
 
 // world
 
@@ -571,6 +580,9 @@ extern void startmodelquery(occludequery *query);
 extern void endmodelquery();
 extern void preloadmodelshaders();
 extern void preloadusedmapmodels(bool msg = false, bool bih = false);
+extern bool modelcachekey(const char *kind, const char *name, const char *file, uint salt, string &key);
+extern uchar *loadmodelcache(const char *key, ucharbuf &p);
+extern stream *savemodelcache(const char *key);
 
 // renderparticles
 extern void particleinit();
@@ -2,6 +2,7 @@
 
 #define MAXLIGHTMAPTASKS 4096
 #define LIGHTMAPBUFSIZE (2*1024*1024)
+#define LIGHTMAPPACKINTERVAL 256
 
 struct lightmapinfo;
 struct lightmaptask;
@@ -66,12 +67,21 @@ struct lightmapext
 static vector<lightmapworker *> lightmapworkers;
 static vector<lightmaptask> lightmaptasks[2];
 static vector<lightmapext> lightmapexts;
-static int packidx = 0, allocidx = 0;
+static volatile int packidx = 0, allocidx = 0; // allocidx holds the batch number in its upper bits
+static int taskbatch = 0;
 static SDL_mutex *lightlock = NULL, *tasklock = NULL;
 static SDL_cond *fullcond = NULL, *emptycond = NULL;
 
 int lightmapping = 0;
 
+#ifdef WIN32
+static inline bool atomiccas(volatile int &n, int oldval, int newval) { return InterlockedCompareExchange((volatile LONG *)&n, newval, oldval) == oldval; }
+static inline void atomicfence() { MemoryBarrier(); }
+#else
+static inline bool atomiccas(volatile int &n, int oldval, int newval) { return __sync_bool_compare_and_swap(&n, oldval, newval); }
+static inline void atomicfence() { __sync_synchronize(); }
+#endif
+
 vector<LightMap> lightmaps;
 
 VARR(lightprecision, 1, 32, 1024);
@@ -249,6 +259,15 @@ void show_calclight_progress()
 {
     float bar1 = float(progress) / float(allocnodes);
     defformatstring(text1)("%d%% using %d textures", int(bar1 * 100), lightmaps.length());
+    uint hits = 0, lookups = 0;
+    loopv(lightmapworkers)
+    {
+        uint whits, wlookups;
+        getshadowraycachestats(lightmapworkers[i]->shadowraycache, whits, wlookups);
+        hits += whits;
+        lookups += wlookups;
+    }
+    if(lookups) formatstring(text1)("%d%% using %d textures, %d%% occluder cache hits", int(bar1 * 100), lightmaps.length(), int(100.0f * hits / lookups));
 
     if(LM_PACKW <= hwtexsize && !progresstex)
     {
@@ -310,9 +329,68 @@ bool PackNode::insert(ushort &tx, ushort &ty, ushort tw, ushort th)
     return inserted;
 }
 
+bool SkylinePacker::fits(int i, int tw, int th, int &ty) const
+{
+    if(skyline[i].x + tw > LM_PACKW) return false;
+    ty = 0;
+    for(int left = tw; left > 0; left -= skyline[i++].w)
+    {
+        ty = max(ty, int(skyline[i].y));
+        if(ty + th > LM_PACKH) return false;
+    }
+    return true;
+}
+
+bool SkylinePacker::insert(ushort &tx, ushort &ty, ushort tw, ushort th)
+{
+    int best = -1, besttop = LM_PACKH+1, bestw = LM_PACKW+1;
+    loopv(skyline)
+    {
+        int y;
+        if(!fits(i, tw, th, y)) continue;
+        if(y + th < besttop || (y + th == besttop && skyline[i].w < bestw))
+        {
+            best = i;
+            besttop = y + th;
+            bestw = skyline[i].w;
+        }
+    }
+    if(best < 0) return false;
+
+    tx = skyline[best].x;
+    ty = besttop - th;
+    SkylineNode n = { tx, ushort(besttop), tw };
+    skyline.insert(best, n);
+    for(int i = best+1; i < skyline.length();)
+    {
+        SkylineNode &cur = skyline[i], &prev = skyline[i-1];
+        int overlap = prev.x + prev.w - cur.x;
+        if(overlap <= 0) break;
+        if(overlap < cur.w)
+        {
+            cur.x += overlap;
+            cur.w -= overlap;
+            break;
+        }
+        skyline.remove(i);
+    }
+    for(int i = max(best-1, 0); i+1 < skyline.length();)
+    {
+        if(skyline[i].y == skyline[i+1].y)
+        {
+            skyline[i].w += skyline[i+1].w;
+            skyline.remove(i+1);
+        }
+        else if(i > best) break;
+        else i++;
+    }
+    return true;
+}
+
 bool LightMap::insert(ushort &tx, ushort &ty, uchar *src, ushort tw, ushort th)
 {
-    if((type&LM_TYPE) != LM_BUMPMAP1 && !packroot.insert(tx, ty, tw, th))
+    if((type&LM_TYPE) != LM_BUMPMAP1 && 
+       !(packer == LM_PACK_SKYLINE ? skyline.insert(tx, ty, tw, th) : packroot.insert(tx, ty, tw, th)))
         return false;
 
     copy(tx, ty, src, tw, th);
@@ -360,6 +438,8 @@ struct layoutinfo
     uchar w, h;
 };
 
+VAR(lmpacker, 0, LM_PACK_GUILLOTINE, 1);
+
 static void insertlightmap(lightmapinfo &li, layoutinfo &si)
 {
     loopv(lightmaps)
@@ -378,6 +458,7 @@ static void insertlightmap(lightmapinfo &li, layoutinfo &si)
     LightMap &l = lightmaps.add();
     l.type = li.type;
     l.bpp = li.bpp;
+    l.packer = lmpacker;
     l.data = new uchar[li.bpp*LM_PACKW*LM_PACKH];
     memset(l.data, 0, li.bpp*LM_PACKW*LM_PACKH);
     ASSERT(l.insert(si.x, si.y, li.colorbuf, si.w, si.h));
@@ -515,99 +596,131 @@ static void updatelightmap(const layoutinfo &surface)
 }
  
         
-static uint generatelumel(lightmapworker *w, const float tolerance, uint lightmask, const vector<const extentity *> &lights, const vec &target, const vec &normal, vec &sample, int x, int y)
+// samples of a packet all belong to the same lumel, so their shadow rays towards each light are traced together
+static uint generatelumels(lightmapworker *w, int numsamples, const float *tolerance, uint lightmask, const vector<const extentity *> &lights, const vec *target, const vec &normal, vec *sample, int x, int y)
 {
-    vec avgray(0, 0, 0);
-    float r = 0, g = 0, b = 0;
+    vec avgray[SHADOWRAYPACKET], origins[SHADOWRAYPACKET], rays[SHADOWRAYPACKET], color[SHADOWRAYPACKET];
+    float attenuation[SHADOWRAYPACKET], angle[SHADOWRAYPACKET], radius[SHADOWRAYPACKET], dist[SHADOWRAYPACKET];
+    loopj(numsamples) { avgray[j] = color[j] = vec(0, 0, 0); }
+    int mode = RAY_SHADOW | (lmshadows > 1 ? RAY_ALPHAPOLY : 0);
     uint lightused = 0;
     loopv(lights)
     {
         if(lightmask&(1<<i)) continue;
         const extentity &light = *lights[i];
-        vec ray = target;
-        ray.sub(light.o);
-        float mag = ray.magnitude();
-        if(!mag) continue;
-        float attenuation = 1;
-        if(light.attr1)
-        {
-            attenuation -= mag / float(light.attr1);
-            if(attenuation <= 0) continue;
-        }
-        ray.mul(1.0f / mag);
-        float angle = -ray.dot(normal);
-        if(angle <= 0) continue;
-        if(light.attached && light.attached->type==ET_SPOTLIGHT)
-        {
-            vec spot = vec(light.attached->o).sub(light.o).normalize();
-            float maxatten = sincos360[clamp(int(light.attached->attr1), 1, 89)].x, spotatten = (ray.dot(spot) - maxatten) / (1 - maxatten);
-            if(spotatten <= 0) continue;
-            attenuation *= spotatten;
+        int lit = 0;
+        loopj(numsamples)
+        {
+            vec &ray = rays[j];
+            ray = target[j];
+            ray.sub(light.o);
+            float mag = ray.magnitude();
+            if(!mag) continue;
+            attenuation[j] = 1;
+            if(light.attr1)
+            {
+                attenuation[j] -= mag / float(light.attr1);
+                if(attenuation[j] <= 0) continue;
+            }
+            ray.mul(1.0f / mag);
+            angle[j] = -ray.dot(normal);
+            if(angle[j] <= 0) continue;
+            if(light.attached && light.attached->type==ET_SPOTLIGHT)
+            {
+                vec spot = vec(light.attached->o).sub(light.o).normalize();
+                float maxatten = sincos360[clamp(int(light.attached->attr1), 1, 89)].x, spotatten = (ray.dot(spot) - maxatten) / (1 - maxatten);
+                if(spotatten <= 0) continue;
+                attenuation[j] *= spotatten;
+            }
+            origins[j] = light.o;
+            radius[j] = mag - tolerance[j];
+            lit |= 1<<j;
         }
-        if(lmshadows && mag)
+        if(lit && lmshadows)
         {
-            float dist = shadowray(w->shadowraycache, light.o, ray, mag - tolerance, RAY_SHADOW | (lmshadows > 1 ? RAY_ALPHAPOLY : 0));
-            if(dist < mag - tolerance) continue;
+            shadowrays(w->shadowraycache, origins, rays, radius, dist, mode, lit);
+            loopj(numsamples) if(lit&(1<<j) && dist[j] < radius[j]) lit &= ~(1<<j);
         }
+        if(!lit) continue;
         lightused |= 1<<i;
-        float intensity;
-        switch(w->type&LM_TYPE)
+        loopj(numsamples) if(lit&(1<<j))
         {
-            case LM_BUMPMAP0: 
-                intensity = attenuation; 
-                avgray.add(ray.mul(-attenuation));
-                break;
-            default:
-                intensity = angle * attenuation;
-                break;
+            float intensity;
+            switch(w->type&LM_TYPE)
+            {
+                case LM_BUMPMAP0: 
+                    intensity = attenuation[j]; 
+                    avgray[j].add(rays[j].mul(-attenuation[j]));
+                    break;
+                default:
+                    intensity = angle[j] * attenuation[j];
+                    break;
+            }
+            color[j].add(vec(light.attr2, light.attr3, light.attr4).mul(intensity));
         }
-        r += intensity * float(light.attr2);
-        g += intensity * float(light.attr3);
-        b += intensity * float(light.attr4);
     }
     if(sunlight)
     {
         float angle = sunlightdir.dot(normal);
-        if(angle > 0 &&
-           (!lmshadows ||
-            shadowray(w->shadowraycache, vec(sunlightdir).mul(tolerance).add(target), sunlightdir, 1e16f, RAY_SHADOW | (lmshadows > 1 ? RAY_ALPHAPOLY : 0) | (skytexturelight ? RAY_SKIPSKY : 0)) > 1e15f))
+        if(angle > 0)
         {
-            float intensity;
-            switch(w->type&LM_TYPE)
+            int lit = (1<<numsamples)-1;
+            if(lmshadows)
             {
-                case LM_BUMPMAP0:
-                    intensity = 1;
-                    avgray.add(sunlightdir);
-                    break;
-                default:
-                    intensity = angle;
-                    break;
+                loopj(numsamples)
+                {
+                    origins[j] = vec(sunlightdir).mul(tolerance[j]).add(target[j]);
+                    rays[j] = sunlightdir;
+                    radius[j] = 1e16f;
+                }
+                shadowrays(w->shadowraycache, origins, rays, radius, dist, mode | (skytexturelight ? RAY_SKIPSKY : 0), lit);
+                loopj(numsamples) if(dist[j] <= 1e15f) lit &= ~(1<<j);
             }
-            r += intensity * (sunlightcolor.x*sunlightscale);
-            g += intensity * (sunlightcolor.y*sunlightscale);
-            b += intensity * (sunlightcolor.z*sunlightscale);
-        }
-    }
-    switch(w->type&LM_TYPE)
-    {
-        case LM_BUMPMAP0:
-            if(avgray.iszero()) break;
-            // transform to tangent space
-            extern vec orientation_tangent[6][3];
-            extern vec orientation_binormal[6][3];            
-            vec S(orientation_tangent[w->rotate][dimension(w->orient)]),
-                T(orientation_binormal[w->rotate][dimension(w->orient)]);
-            normal.orthonormalize(S, T);
-            avgray.normalize();
-            w->raydata[y*w->w+x].add(vec(S.dot(avgray)/S.magnitude(), T.dot(avgray)/T.magnitude(), normal.dot(avgray)));
-            break;
+            loopj(numsamples) if(lit&(1<<j))
+            {
+                float intensity;
+                switch(w->type&LM_TYPE)
+                {
+                    case LM_BUMPMAP0:
+                        intensity = 1;
+                        avgray[j].add(sunlightdir);
+                        break;
+                    default:
+                        intensity = angle;
+                        break;
+                }
+                color[j].add(vec(sunlightcolor.x, sunlightcolor.y, sunlightcolor.z).mul(intensity*sunlightscale));
+            }
+        }
+    }
+    loopj(numsamples)
+    {
+        switch(w->type&LM_TYPE)
+        {
+            case LM_BUMPMAP0:
+                if(avgray[j].iszero()) break;
+                // transform to tangent space
+                extern vec orientation_tangent[6][3];
+                extern vec orientation_binormal[6][3];            
+                vec S(orientation_tangent[w->rotate][dimension(w->orient)]),
+                    T(orientation_binormal[w->rotate][dimension(w->orient)]);
+                normal.orthonormalize(S, T);
+                avgray[j].normalize();
+                w->raydata[y*w->w+x].add(vec(S.dot(avgray[j])/S.magnitude(), T.dot(avgray[j])/T.magnitude(), normal.dot(avgray[j])));
+                break;
+        }
+        sample[j].x = min(255.0f, max(color[j].x, float(ambientcolor[0])));
+        sample[j].y = min(255.0f, max(color[j].y, float(ambientcolor[1])));
+        sample[j].z = min(255.0f, max(color[j].z, float(ambientcolor[2])));
     }
-    sample.x = min(255.0f, max(r, float(ambientcolor[0])));
-    sample.y = min(255.0f, max(g, float(ambientcolor[1])));
-    sample.z = min(255.0f, max(b, float(ambientcolor[2])));
     return lightused;
 }
 
+static inline uint generatelumel(lightmapworker *w, float tolerance, uint lightmask, const vector<const extentity *> &lights, const vec &target, const vec &normal, vec &sample, int x, int y)
+{
+    return generatelumels(w, 1, &tolerance, lightmask, lights, &target, normal, &sample, x, y);
+}
+
 static bool lumelsample(const vec &sample, int aasample, int stride)
 {
     if(sample.x >= int(ambientcolor[0])+1 || sample.y >= int(ambientcolor[1])+1 || sample.z >= int(ambientcolor[2])+1) return true;
@@ -653,9 +766,29 @@ static void calcskylight(lightmapworker *w, const vec &o, const vec &normal, flo
     flags |= RAY_SHADOW;
     if(skytexturelight) flags |= RAY_SKIPSKY;
     int hit = 0;
-    if(w) loopi(17) 
+    if(w) 
     {
-        if(normal.dot(rays[i])>=0 && shadowray(w->shadowraycache, vec(rays[i]).mul(tolerance).add(o), rays[i], 1e16f, flags, t)>1e15f) hit++;
+        vec origins[SHADOWRAYPACKET], dirs[SHADOWRAYPACKET];
+        float radius[SHADOWRAYPACKET], dist[SHADOWRAYPACKET];
+        int lanes = 0;
+        loopi(17) 
+        {
+            if(normal.dot(rays[i])>=0)
+            {
+                int j = 0;
+                while(lanes&(1<<j)) j++;
+                origins[j] = vec(rays[i]).mul(tolerance).add(o);
+                dirs[j] = rays[i];
+                radius[j] = 1e16f;
+                lanes |= 1<<j;
+            }
+            if(lanes && (lanes == (1<<SHADOWRAYPACKET)-1 || i == 16))
+            {
+                shadowrays(w->shadowraycache, origins, dirs, radius, dist, flags, lanes, t);
+                loopj(SHADOWRAYPACKET) if(lanes&(1<<j) && dist[j]>1e15f) hit++;
+                lanes = 0;
+            }
+        }
     }
     else loopi(17) 
     {
@@ -799,17 +932,24 @@ static bool generatelightmap(lightmapworker *w, float lpu, const lerpvert *lv, i
 #define AA_EDGE_TOLERANCE(x, y, i) EDGE_TOLERANCE(x + aacoords[i][0], y + aacoords[i][1])
                 vec u = x < sidex ? vec(xstep1).mul(x).add(vec(ystep1).mul(y)).add(origin1) : vec(xstep2).mul(x).add(vec(ystep2).mul(y)).add(origin2);
                 const vec *offsets = x < sidex ? offsets1 : offsets2;
-                vec n = vec(normal).normalize();
+                vec n = vec(normal).normalize(), targets[SHADOWRAYPACKET], s[SHADOWRAYPACKET];
+                float tolerances[SHADOWRAYPACKET];
                 loopi(aasample-1)
-                    generatelumel(w, AA_EDGE_TOLERANCE(x, y, i+1) * tolerance, lightmask, w->lights, vec(u).add(offsets[i+1]), n, *sample++, x, y);
+                {
+                    targets[i] = vec(u).add(offsets[i+1]);
+                    tolerances[i] = AA_EDGE_TOLERANCE(x, y, i+1) * tolerance;
+                }
+                generatelumels(w, aasample-1, tolerances, lightmask, w->lights, targets, n, sample, x, y);
+                sample += aasample-1;
                 if(lmaa == 3) 
                 {
                     loopi(4)
                     {
-                        vec s;
-                        generatelumel(w, AA_EDGE_TOLERANCE(x, y, i+4) * tolerance, lightmask, w->lights, vec(u).add(offsets[i+4]), n, s, x, y);
-                        center.add(s);
+                        targets[i] = vec(u).add(offsets[i+4]);
+                        tolerances[i] = AA_EDGE_TOLERANCE(x, y, i+4) * tolerance;
                     }
+                    generatelumels(w, 4, tolerances, lightmask, w->lights, targets, n, s, x, y);
+                    loopi(4) center.add(s[i]);
                     center.div(5);
                 }
             }
@@ -1160,6 +1300,7 @@ static int packlightmaps(lightmapworker *w = NULL)
     for(; packidx < lightmaptasks[0].length(); packidx++, numpacked++)
     {
         lightmaptask &t = lightmaptasks[0][packidx];
+        atomicfence();
         if(!t.lightmaps) break;
         if(t.ext && t.c->ext != t.ext) 
         {
@@ -1246,7 +1387,7 @@ static lightmapinfo *alloclightmap(lightmapworker *w)
             availspace1 = min(availspace, LIGHTMAPBUFSIZE - bufend);
             availspace2 = min(availspace, w->bufstart);
             if(availspace >= needspace && (max(availspace1, availspace2) >= needspace || (availspace1 >= needspace1 && availspace2 >= needspace2))) break;
-            if(packlightmaps(w)) continue;
+            if(!tasklock && packlightmaps(w)) continue;
             if(!w->spacecond || !tasklock) break;
             w->needspace = true;
             SDL_CondWait(w->spacecond, tasklock);
@@ -1673,30 +1814,443 @@ static lightmapinfo *setupsurfaces(lightmapworker *w, lightmaptask &task)
     return w->curlightmaps ? w->curlightmaps : (lightmapinfo *)-1;
 }
 
+static lightmaptask *claimtask(lightmaptask *tasks, int numtasks, int batch, int &idx)
+{
+    for(;;)
+    {
+        int cur = allocidx;
+        idx = cur&0xFFFF;
+        if(cur>>16 != batch || idx >= numtasks) return NULL;
+        if(atomiccas(allocidx, cur, cur+1)) return &tasks[idx];
+    }
+}
+
 int lightmapworker::work(void *data)
 {
     lightmapworker *w = (lightmapworker *)data;
     SDL_LockMutex(tasklock);
     while(!w->doneworking)
     {
-        if(allocidx < lightmaptasks[0].length())
+        int batch = taskbatch, numtasks = lightmaptasks[0].length(), idx;
+        lightmaptask *tasks = lightmaptasks[0].getbuf(), *t;
+        SDL_UnlockMutex(tasklock);
+        while(!w->doneworking && (t = claimtask(tasks, numtasks, batch, idx)))
+        {
+            t->worker = w;
+            lightmapinfo *l = setupsurfaces(w, *t);
+            atomicfence();
+            t->lightmaps = l;
+            atomicfence();
+            if(idx == packidx)
+            {
+                SDL_LockMutex(tasklock);
+                SDL_CondSignal(emptycond);
+                SDL_UnlockMutex(tasklock);
+            }
+        }
+        SDL_LockMutex(tasklock);
+        if(batch == taskbatch && !w->doneworking) SDL_CondWait(fullcond, tasklock);
+    }
+    SDL_UnlockMutex(tasklock);
+    return 0;
+}
+
+// distributed baking: other instances with the same map loaded join via lightfarmjoin and bake
+// tasks claimed on their behalf, shipping back the surfaces and raw lightmaps for packing here
+
+#define LIGHTFARMVERSION 1
+#define LIGHTFARMMAXMSG (8*1024*1024)
+
+enum { LF_SETUP = 0, LF_READY, LF_TASK, LF_RESULT, LF_DONE };
+
+VAR(lightfarm, 0, 0, 1);
+VAR(lightfarmport, 1, 28790, 0xFFFF);
+SVAR(lightfarmhost, "127.0.0.1");                       // address the coordinator listens on, "*" for all interfaces
+VAR(lightfarmtasks, 1, 16, 256);
+
+struct lightfarmclient
+{
+    ENetSocket socket;
+    ENetAddress address;
+    bool ready;
+    vector<uchar> input, output;
+    int outputpos;
+    vector<int> tasks;
+
+    lightfarmclient() : socket(ENET_SOCKET_NULL), ready(false), outputpos(0) {}
+};
+
+static ENetSocket lightfarmsocket = ENET_SOCKET_NULL;
+static vector<lightfarmclient *> lightfarmclients;
+static vector<uchar *> lightfarmbufs;
+static lightmapworker *lightfarmworker = NULL;
+static int lightfarmquality = 0, lightfarmbaked = 0, lightfarmorphans = 0;
+
+static const char * const lightfarmvars[] = { "lmshadows", "lmaa", "lerptjoints", "edgetolerance", "adaptivesample" };
+
+static int beginlightfarmmsg(vector<uchar> &out, int type)
+{
+    int start = out.length();
+    out.pad(4);
+    putint(out, type);
+    return start;
+}
+
+static void endlightfarmmsg(vector<uchar> &out, int start)
+{
+    uint len = out.length() - start - 4;
+    loopi(4) out[start + i] = (len>>(8*i))&0xFF;
+}
+
+static bool getlightfarmmsg(vector<uchar> &in, int &pos, ucharbuf &msg)
+{
+    if(in.length() - pos < 4) return false;
+    uint len = 0;
+    loopi(4) len |= uint(in[pos + i])<<(8*i);
+    if(len > LIGHTFARMMAXMSG) { msg = ucharbuf(NULL, 0); msg.forceoverread(); return true; }
+    if(uint(in.length() - pos - 4) < len) return false;
+    msg = ucharbuf(&in[pos + 4], len);
+    pos += 4 + len;
+    return true;
+}
+
+static const uchar *getlightfarmdata(ucharbuf &p, int len)
+{
+    if(len < 0 || p.remaining() < len) { p.forceoverread(); return NULL; }
+    return p.subbuf(len).buf;
+}
+
+static lightmapinfo *newlightfarmmap(cube *c, int surface, int type, int w, int h, int bpp, int layers, const uchar *colorbuf, const bvec *raybuf)
+{
+    int colorsize = w*h*bpp, raysize = (type&LM_TYPE) == LM_BUMPMAP0 ? w*h*3 : 0;
+    uchar *buf = new uchar[sizeof(lightmapinfo) + colorsize + raysize];
+    lightfarmbufs.add(buf);
+    lightmapinfo *l = (lightmapinfo *)buf;
+    l->next = NULL;
+    l->c = c;
+    l->colorbuf = (uchar *)(l + 1);
+    memcpy(l->colorbuf, colorbuf, colorsize);
+    l->raybuf = raysize ? (bvec *)&l->colorbuf[colorsize] : NULL;
+    if(raysize) memcpy(l->raybuf, raybuf, raysize);
+    l->packed = false;
+    l->type = type;
+    l->w = w;
+    l->h = h;
+    l->bpp = bpp;
+    l->bufsize = 0;
+    l->surface = surface;
+    l->layers = layers;
+    return l;
+}
+
+static void finishlightfarmtask(lightmaptask &t, lightmapinfo *first)
+{
+    atomicfence();
+    t.lightmaps = first ? first : (lightmapinfo *)-1;
+    atomicfence();
+}
+
+static void bakelightfarmorphan(int idx)
+{
+    lightmaptask &t = lightmaptasks[0][idx];
+    lightmapworker *w = lightfarmworker;
+    w->bufstart = w->bufused = 0;
+    w->firstlightmap = w->lastlightmap = w->curlightmaps = NULL;
+    t.worker = w;
+    lightmapinfo *l = setupsurfaces(w, t), *first = NULL, *last = NULL;
+    if(l != (lightmapinfo *)-1) for(; l && l->c == t.c; l = l->next) if(l->surface >= 0)
+    {
+        lightmapinfo *copy = newlightfarmmap(t.c, l->surface, l->type, l->w, l->h, l->bpp, l->layers, l->colorbuf, l->raybuf);
+        if(last) last->next = copy;
+        else first = copy;
+        last = copy;
+    }
+    finishlightfarmtask(t, first);
+    lightfarmorphans++;
+}
+
+static void droplightfarmclient(int n, const char *reason = NULL)
+{
+    lightfarmclient *c = lightfarmclients[n];
+    string ip;
+    if(enet_address_get_host_ip(&c->address, ip, sizeof(ip)) < 0) copystring(ip, "-");
+    if(reason) conoutf(CON_WARN, "dropped lightmap worker %s: %s", ip, reason);
+    else if(c->ready) conoutf("lightmap worker %s disconnected", ip);
+    loopv(c->tasks) bakelightfarmorphan(c->tasks[i]);
+    enet_socket_destroy(c->socket);
+    delete c;
+    lightfarmclients.remove(n);
+}
+
+static void sendlightfarmsetup(lightfarmclient &c, int quality)
+{
+    int start = beginlightfarmmsg(c.output, LF_SETUP);
+    putint(c.output, LIGHTFARMVERSION);
+    putint(c.output, quality);
+    sendstring(game::getclientmap(), c.output);
+    vector<ident *> vars;
+    enumerate(idents, ident, id,
+    {
+        if((id.type == ID_VAR || id.type == ID_FVAR) && id.flags&IDF_OVERRIDE && !(id.flags&IDF_READONLY)) vars.add(&id);
+    });
+    loopi(sizeof(lightfarmvars)/sizeof(lightfarmvars[0]))
+    {
+        ident *id = idents.access(lightfarmvars[i]);
+        if(id && id->type == ID_VAR) vars.add(id);
+    }
+    putint(c.output, vars.length());
+    loopv(vars)
+    {
+        ident &id = *vars[i];
+        sendstring(id.name, c.output);
+        putint(c.output, id.type);
+        if(id.type == ID_VAR) putint(c.output, *id.storage.i);
+        else putfloat(c.output, *id.storage.f);
+    }
+    endlightfarmmsg(c.output, start);
+}
+
+static const char *checklightfarmready(lightfarmclient &c, ucharbuf &p)
+{
+    int numsurfs = getint(p), numverts = getint(p), size = getint(p), nodes = getint(p), numents = getint(p);
+    if(p.overread()) return "bad message";
+    if(numsurfs != int(sizeof(surfaceinfo)) || numverts != int(sizeof(vertinfo))) return "incompatible build";
+    if(size != worldsize || nodes != allocnodes || numents != entities::getents().length()) return "map does not match";
+    string ip;
+    if(enet_address_get_host_ip(&c.address, ip, sizeof(ip)) < 0) copystring(ip, "-");
+    conoutf("lightmap worker %s joined", ip);
+    c.ready = true;
+    return NULL;
+}
+
+static bool receivelightfarmresult(lightfarmclient &c, ucharbuf &p)
+{
+    int idx = getint(p), pending = c.tasks.find(idx);
+    if(pending < 0 || !lightmaptasks[0].inrange(idx)) return false;
+    lightmaptask &t = lightmaptasks[0][idx];
+    const surfaceinfo *surfaces = NULL;
+    const vertinfo *verts = NULL;
+    int numverts = 0;
+    if(getint(p))
+    {
+        surfaces = (const surfaceinfo *)getlightfarmdata(p, 6*sizeof(surfaceinfo));
+        numverts = getint(p);
+        if(numverts < 0 || numverts > 6*2*MAXFACEVERTS) return false;
+        verts = (const vertinfo *)getlightfarmdata(p, numverts*sizeof(vertinfo));
+        if(surfaces) loopi(6) if(surfaces[i].verts + surfaces[i].totalverts() > numverts) return false;
+    }
+    struct lightmapdesc { int surface, type, w, h, bpp, layers; const uchar *colorbuf, *raybuf; } descs[6*2];
+    int numlms = getint(p);
+    if(numlms < 0 || numlms > int(sizeof(descs)/sizeof(descs[0]))) return false;
+    loopi(numlms)
+    {
+        lightmapdesc &d = descs[i];
+        d.surface = getint(p);
+        d.type = getint(p);
+        d.w = getint(p);
+        d.h = getint(p);
+        d.bpp = getint(p);
+        d.layers = getint(p);
+        if(d.surface < 0 || d.surface >= 6 || d.w <= 0 || d.w > LM_MAXW || d.h <= 0 || d.h > LM_MAXH) return false;
+        if(d.type&~(LM_TYPE|LM_ALPHA) || ((d.type&LM_TYPE) != LM_DIFFUSE && (d.type&LM_TYPE) != LM_BUMPMAP0) || d.bpp != (d.type&LM_ALPHA ? 4 : 3)) return false;
+        d.colorbuf = getlightfarmdata(p, d.w*d.h*d.bpp);
+        d.raybuf = (d.type&LM_TYPE) == LM_BUMPMAP0 ? getlightfarmdata(p, d.w*d.h*3) : NULL;
+    }
+    if(p.overread()) return false;
+
+    cube &cu = *t.c;
+    if(surfaces)
+    {
+        cubeext *ext = cu.ext && cu.ext->maxverts >= numverts ? cu.ext : growcubeext(cu.ext, numverts);
+        memcpy(ext->surfaces, surfaces, sizeof(ext->surfaces));
+        memcpy(ext->verts(), verts, numverts*sizeof(vertinfo));
+        t.ext = ext;
+    }
+    lightmapinfo *first = NULL, *last = NULL;
+    loopi(numlms)
+    {
+        lightmapdesc &d = descs[i];
+        lightmapinfo *l = newlightfarmmap(t.c, d.surface, d.type, d.w, d.h, d.bpp, d.layers, d.colorbuf, (const bvec *)d.raybuf);
+        if(last) last->next = l;
+        else first = l;
+        last = l;
+    }
+    finishlightfarmtask(t, first);
+    c.tasks.removeunordered(pending);
+    lightfarmbaked++;
+    return true;
+}
+
+static const char *parselightfarmclient(lightfarmclient &c)
+{
+    int pos = 0;
+    ucharbuf p(NULL, 0);
+    while(getlightfarmmsg(c.input, pos, p))
+    {
+        int type = getint(p);
+        if(p.overread()) return "bad message";
+        switch(type)
         {
-            lightmaptask &t = lightmaptasks[0][allocidx++];
-            t.worker = w;
-            SDL_UnlockMutex(tasklock);
-            lightmapinfo *l = setupsurfaces(w, t);
-            SDL_LockMutex(tasklock);
-            t.lightmaps = l;
-            packlightmaps(w);
+            case LF_READY:
+            {
+                if(c.ready) return "bad message";
+                const char *err = checklightfarmready(c, p);
+                if(err) return err;
+                break;
+            }
+            case LF_RESULT:
+                if(!c.ready || !receivelightfarmresult(c, p)) return "bad result";
+                break;
+            default:
+                return "bad message";
         }
-        else 
+    }
+    if(pos) c.input.remove(0, pos);
+    return NULL;
+}
+
+static void assignlightfarmtasks(lightfarmclient &c)
+{
+    if(!c.ready) return;
+    int batch = taskbatch, numtasks = lightmaptasks[0].length(), idx;
+    lightmaptask *tasks = lightmaptasks[0].getbuf(), *t;
+    while(c.tasks.length() < lightfarmtasks && (t = claimtask(tasks, numtasks, batch, idx)))
+    {
+        t->worker = lightfarmworker;
+        c.tasks.add(idx);
+        int start = beginlightfarmmsg(c.output, LF_TASK);
+        putint(c.output, idx);
+        putint(c.output, t->o.x);
+        putint(c.output, t->o.y);
+        putint(c.output, t->o.z);
+        putint(c.output, t->size);
+        putint(c.output, t->usefaces);
+        endlightfarmmsg(c.output, start);
+    }
+}
+
+static void servelightfarm(int timeout)
+{
+    ENetSocketSet readset, writeset;
+    ENET_SOCKETSET_EMPTY(readset);
+    ENET_SOCKETSET_EMPTY(writeset);
+    ENET_SOCKETSET_ADD(readset, lightfarmsocket);
+    ENetSocket maxsock = lightfarmsocket;
+    loopv(lightfarmclients)
+    {
+        lightfarmclient &c = *lightfarmclients[i];
+        assignlightfarmtasks(c);
+        if(c.output.length()) ENET_SOCKETSET_ADD(writeset, c.socket);
+        ENET_SOCKETSET_ADD(readset, c.socket);
+        maxsock = max(maxsock, c.socket);
+    }
+    if(enet_socketset_select(maxsock, &readset, &writeset, timeout) <= 0) return;
+
+    if(ENET_SOCKETSET_CHECK(readset, lightfarmsocket))
+    {
+        lightfarmclient *c = new lightfarmclient;
+        c->socket = enet_socket_accept(lightfarmsocket, &c->address);
+        if(c->socket == ENET_SOCKET_NULL) delete c;
+        else
         {
-            if(packidx >= lightmaptasks[0].length()) SDL_CondSignal(emptycond);   
-            SDL_CondWait(fullcond, tasklock);
+            enet_socket_set_option(c->socket, ENET_SOCKOPT_NONBLOCK, 1);
+            sendlightfarmsetup(*c, lightfarmquality);
+            lightfarmclients.add(c);
         }
     }
-    SDL_UnlockMutex(tasklock);
-    return 0;
+
+    loopv(lightfarmclients)
+    {
+        lightfarmclient &c = *lightfarmclients[i];
+        if(c.output.length() && ENET_SOCKETSET_CHECK(writeset, c.socket))
+        {
+            ENetBuffer buf;
+            buf.data = &c.output[c.outputpos];
+            buf.dataLength = c.output.length() - c.outputpos;
+            int res = enet_socket_send(c.socket, NULL, &buf, 1);
+            if(res < 0) { droplightfarmclient(i--); continue; }
+            c.outputpos += res;
+            if(c.outputpos >= c.output.length())
+            {
+                c.output.setsize(0);
+                c.outputpos = 0;
+            }
+        }
+        if(ENET_SOCKETSET_CHECK(readset, c.socket))
+        {
+            if(c.input.capacity() - c.input.length() < 65536) c.input.reserve(65536);
+            ENetBuffer buf;
+            buf.data = c.input.getbuf() + c.input.length();
+            buf.dataLength = c.input.capacity() - c.input.length();
+            int res = enet_socket_receive(c.socket, NULL, &buf, 1);
+            if(res <= 0) { droplightfarmclient(i--); continue; }
+            c.input.advance(res);
+            const char *err = parselightfarmclient(c);
+            if(err) { droplightfarmclient(i--, err); continue; }
+        }
+    }
+}
+
+static void freelightfarmbufs()
+{
+    loopv(lightfarmbufs) delete[] lightfarmbufs[i];
+    lightfarmbufs.setsize(0);
+}
+
+static bool startlightfarm(int quality)
+{
+    lightfarmbaked = lightfarmorphans = 0;
+    if(!lightfarm) return false;
+    ENetAddress address;
+    address.host = ENET_HOST_ANY;
+    address.port = lightfarmport;
+    if(strcmp(lightfarmhost, "*") && enet_address_set_host(&address, lightfarmhost) < 0)
+    {
+        conoutf(CON_ERROR, "could not resolve lightfarm host %s", lightfarmhost);
+        return false;
+    }
+    lightfarmsocket = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+    if(lightfarmsocket != ENET_SOCKET_NULL &&
+       (enet_socket_set_option(lightfarmsocket, ENET_SOCKOPT_REUSEADDR, 1) < 0 ||
+        enet_socket_bind(lightfarmsocket, &address) < 0 ||
+        enet_socket_listen(lightfarmsocket, -1) < 0 ||
+        enet_socket_set_option(lightfarmsocket, ENET_SOCKOPT_NONBLOCK, 1) < 0))
+    {
+        enet_socket_destroy(lightfarmsocket);
+        lightfarmsocket = ENET_SOCKET_NULL;
+    }
+    if(lightfarmsocket == ENET_SOCKET_NULL)
+    {
+        conoutf(CON_ERROR, "could not listen for lightmap workers on %s:%d", lightfarmhost, lightfarmport);
+        return false;
+    }
+    lightfarmquality = quality;
+    if(!lightfarmworker) lightfarmworker = new lightmapworker;
+    lightfarmworker->reset();
+    conoutf("listening for lightmap workers on %s:%d", lightfarmhost, lightfarmport);
+    return true;
+}
+
+static void stoplightfarm()
+{
+    if(lightfarmsocket == ENET_SOCKET_NULL) return;
+    loopv(lightfarmclients)
+    {
+        lightfarmclient &c = *lightfarmclients[i];
+        endlightfarmmsg(c.output, beginlightfarmmsg(c.output, LF_DONE));
+        enet_socket_set_option(c.socket, ENET_SOCKOPT_NONBLOCK, 0);
+        ENetBuffer buf;
+        buf.data = &c.output[c.outputpos];
+        buf.dataLength = c.output.length() - c.outputpos;
+        enet_socket_send(c.socket, NULL, &buf, 1);
+        enet_socket_destroy(c.socket);
+        delete lightfarmclients[i];
+    }
+    lightfarmclients.setsize(0);
+    enet_socket_destroy(lightfarmsocket);
+    lightfarmsocket = ENET_SOCKET_NULL;
+    freelightfarmbufs();
+    if(lightfarmbaked || lightfarmorphans) conoutf("%d lightmap tasks baked by workers, %d reclaimed from dropped workers", lightfarmbaked, lightfarmorphans);
 }
 
 static bool processtasks(bool finish = false)
@@ -1709,19 +2263,46 @@ static bool processtasks(bool finish = false)
             if(lightmaptasks[1].empty()) break;
             lightmaptasks[0].setsize(0);
             lightmaptasks[0].move(lightmaptasks[1]);
-            packidx = allocidx = 0;
+            freelightfarmbufs();
+            packidx = 0;
+            taskbatch = (taskbatch + 1)&0x7FFF;
+            allocidx = taskbatch<<16;
+            atomicfence();
             if(fullcond) SDL_CondBroadcast(fullcond);
         }
         else if(lightmapping > 1)
         {
-            SDL_CondWaitTimeout(emptycond, tasklock, 250);
+            int packed = packlightmaps();
+            if(lightfarmsocket != ENET_SOCKET_NULL)
+            {
+                SDL_UnlockMutex(tasklock);
+                servelightfarm(packed ? 0 : 10);
+                SDL_LockMutex(tasklock);
+            }
+            else if(!packed) SDL_CondWaitTimeout(emptycond, tasklock, 250);
             CHECK_PROGRESS_LOCKED({ SDL_UnlockMutex(tasklock); return false; }, SDL_UnlockMutex(tasklock), SDL_LockMutex(tasklock));
         }
+        else if(lightfarmsocket != ENET_SOCKET_NULL)
+        {
+            // claim rather than walk packidx so that tasks handed to workers are skipped, and leave ring space
+            // for lightmaps that can't be packed until the results in front of them come back
+            lightmapworker *w = lightmapworkers[0];
+            int idx;
+            lightmaptask *t = w->bufused < LIGHTMAPBUFSIZE/4 ? claimtask(lightmaptasks[0].getbuf(), lightmaptasks[0].length(), taskbatch, idx) : NULL;
+            if(t)
+            {
+                t->worker = w;
+                t->lightmaps = setupsurfaces(w, *t);
+            }
+            servelightfarm(t ? 0 : 10);
+            packlightmaps(w);
+            CHECK_PROGRESS(return false);
+        }
         else 
         {
-            while(allocidx < lightmaptasks[0].length())
+            while(packidx < lightmaptasks[0].length())
             {
-                lightmaptask &t = lightmaptasks[0][allocidx++];
+                lightmaptask &t = lightmaptasks[0][packidx];
                 t.worker = lightmapworkers[0];
                 t.lightmaps = setupsurfaces(lightmapworkers[0], t);
                 packlightmaps(lightmapworkers[0]);
@@ -1770,7 +2351,18 @@ static void generatelightmaps(cube *c, int cx, int cy, int cz, int size)
                 t.ext = NULL;
                 t.lightmaps = NULL;
                 t.progress = taskprogress;
-                if(lightmaptasks[1].length() >= MAXLIGHTMAPTASKS && !processtasks()) return;
+                if(lightmaptasks[1].length() >= MAXLIGHTMAPTASKS) { if(!processtasks()) return; }
+                else if(!(lightmaptasks[1].length()%LIGHTMAPPACKINTERVAL))
+                {
+                    // keep packing finished tasks while the next batch is gathered so workers don't stall on buffer space
+                    if(tasklock)
+                    {
+                        SDL_LockMutex(tasklock);
+                        packlightmaps();
+                        SDL_UnlockMutex(tasklock);
+                    }
+                    if(lightfarmsocket != ENET_SOCKET_NULL) servelightfarm(0);
+                }
             }
         }
     nextcube:;
@@ -2066,7 +2658,8 @@ static void setupthreads(int numthreads)
 {
     loopi(2) lightmaptasks[i].setsize(0);
     lightmapexts.setsize(0);
-    packidx = allocidx = 0;
+    packidx = 0;
+    allocidx = taskbatch<<16;
     lightmapping = numthreads;
     if(lightmapping > 1)
     {
@@ -2140,11 +2733,13 @@ void calclight(int *quality)
     check_calclight_progress = false;
     SDL_TimerID timer = SDL_AddTimer(250, calclighttimer, NULL);
     Uint32 start = SDL_GetTicks();
-    calcnormals(lerptjoints > 0);
+    calcnormals(lerptjoints > 0, numthreads);
     show_calclight_progress();
     setupthreads(numthreads);
+    startlightfarm(*quality);
     generatelightmaps(worldroot, 0, 0, 0, worldsize >> 1);
     cleanupthreads();
+    stoplightfarm();
     clearnormals();
     Uint32 end = SDL_GetTicks();
     if(timer) SDL_RemoveTimer(timer);
@@ -2202,7 +2797,7 @@ void patchlight(int *quality)
     SDL_TimerID timer = SDL_AddTimer(250, calclighttimer, NULL);
     if(patchnormals) renderprogress(0, "computing normals...");
     Uint32 start = SDL_GetTicks();
-    if(patchnormals) calcnormals(lerptjoints > 0);
+    if(patchnormals) calcnormals(lerptjoints > 0, numthreads);
     show_calclight_progress();
     setupthreads(numthreads);
     generatelightmaps(worldroot, 0, 0, 0, worldsize >> 1);
@@ -2230,6 +2825,256 @@ void patchlight(int *quality)
 
 COMMAND(patchlight, "i");
 
+static bool sendlightfarmoutput(ENetSocket sock, vector<uchar> &out)
+{
+    for(int pos = 0; pos < out.length();)
+    {
+        ENetBuffer buf;
+        buf.data = &out[pos];
+        buf.dataLength = out.length() - pos;
+        int res = enet_socket_send(sock, NULL, &buf, 1);
+        if(res < 0) return false;
+        pos += res;
+    }
+    out.setsize(0);
+    return true;
+}
+
+// workers only take the map's override vars and lightfarmvars from the coordinator
+static bool islightfarmvar(ident *id)
+{
+    if(!id || id->flags&IDF_READONLY) return false;
+    if(id->flags&IDF_OVERRIDE) return true;
+    loopi(sizeof(lightfarmvars)/sizeof(lightfarmvars[0])) if(!strcmp(id->name, lightfarmvars[i])) return true;
+    return false;
+}
+
+static const char *setuplightfarmjob(ucharbuf &p)
+{
+    int version = getint(p), quality = getint(p);
+    string map;
+    getstring(map, p);
+    if(version != LIGHTFARMVERSION) return "incompatible version";
+    if(strcmp(map, game::getclientmap())) return "map does not match";
+    int numvars = getint(p);
+    loopi(numvars)
+    {
+        string name;
+        getstring(name, p);
+        ident *id = idents.access(name);
+        if(!islightfarmvar(id)) return "bad setup variable";
+        switch(getint(p))
+        {
+            case ID_VAR:
+            {
+                int val = getint(p);
+                if(id && id->type == ID_VAR && *id->storage.i != val) setvar(name, val);
+                break;
+            }
+            case ID_FVAR:
+            {
+                float val = getfloat(p);
+                if(id && id->type == ID_FVAR && *id->storage.f != val) setfvar(name, val);
+                break;
+            }
+            default: return "bad setup";
+        }
+        if(p.overread()) return "bad setup";
+    }
+    if(!setlightmapquality(quality)) return "bad setup";
+    mpremip(true);
+    optimizeblendmap();
+    loadlayermasks();
+    resetlightmaps(false);
+    clearsurfaces(worldroot);
+    calclight_canceled = false;
+    calcnormals(lerptjoints > 0, lightthreads > 0 ? lightthreads : numcpus);
+    setupthreads(1);
+    return NULL;
+}
+
+static bool bakelightfarmtask(ucharbuf &p, vector<uchar> &out)
+{
+    int idx = getint(p);
+    ivec o;
+    o.x = getint(p);
+    o.y = getint(p);
+    o.z = getint(p);
+    int size = getint(p), usefaces = getint(p);
+    if(p.overread() || size <= 0 || size >= worldsize) return false;
+    ivec ro;
+    int rsize;
+    cube &c = lookupcube(o.x, o.y, o.z, -size, ro, rsize);
+    if(ro != o || rsize != size || c.children || isempty(c)) return false;
+    if(c.ext) loopi(6) c.ext->surfaces[i].clear();
+
+    lightmapworker *w = lightmapworkers[0];
+    w->bufstart = w->bufused = 0;
+    w->firstlightmap = w->lastlightmap = w->curlightmaps = NULL;
+    lightmaptask t;
+    t.o = o;
+    t.size = size;
+    t.usefaces = usefaces;
+    t.progress = 0;
+    t.c = &c;
+    t.ext = NULL;
+    t.lightmaps = NULL;
+    t.worker = w;
+    lightmapinfo *l = setupsurfaces(w, t);
+    if(l == (lightmapinfo *)-1) l = NULL;
+    if(t.ext && t.ext != c.ext) setcubeext(c, t.ext);
+
+    int start = beginlightfarmmsg(out, LF_RESULT);
+    putint(out, idx);
+    putint(out, t.ext ? 1 : 0);
+    if(t.ext)
+    {
+        int numverts = 0;
+        loopi(6)
+        {
+            const surfaceinfo &surf = t.ext->surfaces[i];
+            if(surf.totalverts()) numverts = max(numverts, surf.verts + surf.totalverts());
+        }
+        out.put((const uchar *)t.ext->surfaces, sizeof(t.ext->surfaces));
+        putint(out, numverts);
+        out.put((const uchar *)t.ext->verts(), numverts*sizeof(vertinfo));
+    }
+    int numlms = 0;
+    for(lightmapinfo *cur = l; cur && cur->c == t.c; cur = cur->next) if(cur->surface >= 0) numlms++;
+    putint(out, numlms);
+    for(; l && l->c == t.c; l = l->next) if(l->surface >= 0)
+    {
+        putint(out, l->surface);
+        putint(out, l->type);
+        putint(out, l->w);
+        putint(out, l->h);
+        putint(out, l->bpp);
+        putint(out, l->layers);
+        out.put(l->colorbuf, l->w*l->h*l->bpp);
+        if((l->type&LM_TYPE) == LM_BUMPMAP0) out.put((const uchar *)l->raybuf, l->w*l->h*3);
+    }
+    endlightfarmmsg(out, start);
+    return true;
+}
+
+void lightfarmjoin(const char *host, int *port)
+{
+    if(!host[0]) { conoutf(CON_ERROR, "usage: lightfarmjoin host [port]"); return; }
+    if(lightmapping) return;
+    ENetAddress address;
+    address.port = *port > 0 ? *port : lightfarmport;
+    if(enet_address_set_host(&address, host) < 0) { conoutf(CON_ERROR, "could not resolve lightmap coordinator %s", host); return; }
+    ENetSocket sock = enet_socket_create(ENET_SOCKET_TYPE_STREAM);
+    if(sock == ENET_SOCKET_NULL || connectwithtimeout(sock, host, address) < 0)
+    {
+        conoutf(CON_ERROR, "could not connect to lightmap coordinator %s", host);
+        return;
+    }
+
+    renderbackground("baking lightmaps for coordinator... (esc to abort)");
+    vector<uchar> input, output;
+    int numtasks = 0;
+    Uint32 lastprogress = 0;
+    bool setup = false, done = false;
+    const char *err = NULL;
+    while(!done && !err)
+    {
+        enet_uint32 events = ENET_SOCKET_WAIT_RECEIVE;
+        if(enet_socket_wait(sock, &events, 250) >= 0 && events)
+        {
+            if(input.capacity() - input.length() < 65536) input.reserve(65536);
+            ENetBuffer buf;
+            buf.data = input.getbuf() + input.length();
+            buf.dataLength = input.capacity() - input.length();
+            int res = enet_socket_receive(sock, NULL, &buf, 1);
+            if(res <= 0) { err = "lost connection to coordinator"; break; }
+            input.advance(res);
+            int pos = 0;
+            ucharbuf p(NULL, 0);
+            while(!done && !err && getlightfarmmsg(input, pos, p))
+            {
+                switch(getint(p))
+                {
+                    case LF_SETUP:
+                    {
+                        if(setup) { err = "bad message"; break; }
+                        err = setuplightfarmjob(p);
+                        if(err) break;
+                        setup = true;
+                        int start = beginlightfarmmsg(output, LF_READY);
+                        putint(output, sizeof(surfaceinfo));
+                        putint(output, sizeof(vertinfo));
+                        putint(output, worldsize);
+                        putint(output, allocnodes);
+                        putint(output, entities::getents().length());
+                        endlightfarmmsg(output, start);
+                        break;
+                    }
+                    case LF_TASK:
+                        if(!setup || !bakelightfarmtask(p, output)) err = "bad task";
+                        else numtasks++;
+                        break;
+                    case LF_DONE:
+                        done = true;
+                        break;
+                    default:
+                        err = "bad message";
+                        break;
+                }
+                if(!err && output.length() && !sendlightfarmoutput(sock, output)) err = "lost connection to coordinator";
+            }
+            if(pos) input.remove(0, pos);
+        }
+        if(SDL_GetTicks() - lastprogress >= 250)
+        {
+            defformatstring(text)("baked %d lightmap tasks for %s... (esc to abort)", numtasks, host);
+            renderprogress(0, text);
+            lastprogress = SDL_GetTicks();
+            if(interceptkey(SDLK_ESCAPE)) err = "aborted";
+        }
+    }
+    enet_socket_destroy(sock);
+    if(setup)
+    {
+        cleanupthreads();
+        clearnormals();
+        // the job threw away this instance's lightmaps, so get them back from the map file
+        string map;
+        copystring(map, game::getclientmap());
+        if(!load_world(map))
+        {
+            initlights();
+            allchanged();
+            conoutf(CON_WARN, "could not reload map %s, its lightmaps stay cleared until it is reloaded", map);
+        }
+    }
+    if(err) conoutf(CON_ERROR, "lightfarmjoin: %s after %d tasks", err, numtasks);
+    else conoutf("baked %d lightmap tasks for %s", numtasks, host);
+}
+
+COMMAND(lightfarmjoin, "si");
+
+void lmstats()
+{
+    static const char * const typenames[] = { "diffuse", "bumpmap", "bumpmap dir" };
+    uint total = 0, lumels = 0;
+    int atlases = 0;
+    loopv(lightmaps)
+    {
+        LightMap &lm = lightmaps[i];
+        if((lm.type&LM_TYPE) == LM_BUMPMAP1) continue; // shares its layout with the preceding bumpmap
+        atlases++;
+        total += lm.lightmaps;
+        lumels += lm.lumels;
+        conoutf("lightmap %d: %s%s, %d lightmaps, %.1f%% full", i, typenames[min(lm.type&LM_TYPE, 2)], lm.type&LM_ALPHA ? " alpha" : "", lm.lightmaps, lm.lumels*100.0f/(LM_PACKW*LM_PACKH));
+    }
+    conoutf("%d lightmaps in %d atlases (%d textures), %.1f%% average fill",
+        total, atlases, max(lightmaptexs.length() - LMID_RESERVED, 0),
+        atlases ? lumels*100.0f/(atlases*LM_PACKW*LM_PACKH) : 0.0f);
+}
+
+COMMAND(lmstats, "");
+
 void clearlightmaps()
 {
     if(noedit(true)) return;
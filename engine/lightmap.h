@@ -28,6 +28,34 @@ struct PackNode
     bool insert(ushort &tx, ushort &ty, ushort tw, ushort th);
 };
 
+struct SkylineNode
+{
+    ushort x, y, w;
+};
+
+struct SkylinePacker
+{
+    vector<SkylineNode> skyline; // top edge of the packed area, sorted by x
+
+    SkylinePacker()
+    {
+        SkylineNode &n = skyline.add();
+        n.x = n.y = 0;
+        n.w = LM_PACKW;
+    }
+
+    void clear() { skyline.setsize(0); }
+
+    bool fits(int i, int tw, int th, int &ty) const;
+    bool insert(ushort &tx, ushort &ty, ushort tw, ushort th);
+};
+
+enum
+{
+    LM_PACK_GUILLOTINE = 0,
+    LM_PACK_SKYLINE
+};
+
 enum 
 { 
     LM_DIFFUSE = 0, 
@@ -41,14 +69,15 @@ enum
 
 struct LightMap
 {
-    int type, bpp, tex, offsetx, offsety;
+    int type, bpp, tex, offsetx, offsety, packer;
     PackNode packroot;
+    SkylinePacker skyline;
     uint lightmaps, lumels;
     int unlitx, unlity; 
     uchar *data;
 
     LightMap()
-     : type(LM_DIFFUSE), bpp(3), tex(-1), offsetx(-1), offsety(-1),
+     : type(LM_DIFFUSE), bpp(3), tex(-1), offsetx(-1), offsety(-1), packer(LM_PACK_GUILLOTINE),
        lightmaps(0), lumels(0), unlitx(-1), unlity(-1),
        data(NULL)
     {
@@ -63,6 +92,7 @@ struct LightMap
     {
         packroot.clear();
         packroot.available = 0;
+        skyline.clear();
     }
 
     void copy(ushort tx, ushort ty, uchar *src, ushort tw, ushort th);
@@ -114,7 +144,7 @@ struct lerpbounds
     int winding;
 };
 
-extern void calcnormals(bool lerptjoints = false);
+extern void calcnormals(bool lerptjoints = false, int numthreads = 1);
 extern void clearnormals();
 extern void findnormal(const vec &key, const vec &surface, vec &v);
 extern void calclerpverts(const vec2 *c, const vec *n, lerpvert *lv, int &numv);
@@ -1238,6 +1238,7 @@ int main(int argc, char **argv)
         tryedit();
 
         if(lastmillis) game::updateworld();
+        flushlos();
 
         checksleep(lastmillis);
 
@@ -1253,6 +1254,8 @@ int main(int argc, char **argv)
 
         if(minimized) continue;
 
+        flushasynctextures();
+
         inbetweenframes = false;
         if(mainmenu) gl_drawmainmenu(screen->w, screen->h);
         else gl_drawframe(screen->w, screen->h);
@@ -25,6 +25,12 @@ struct md5hierarchy
     int parent, flags, start;
 };
 
+struct md5shader
+{
+    string name;
+    int meshes;
+};
+
 struct md5 : skelmodel, skelloader<md5>
 {
     md5(const char *name) : skelmodel(name) {}
@@ -107,12 +113,10 @@ struct md5 : skelmodel, skelloader<md5>
                     char *start = strchr(buf, '"'), *end = start ? strchr(start+1, '"') : NULL;
                     if(start && end) 
                     {
-                        char *texname = newstring(start+1, end-(start+1));
-                        part *p = loading->parts.last();
-                        p->initskins(notexture, notexture, group->meshes.length());
-                        skin &s = p->skins.last();
-                        s.tex = textureload(makerelpath(dir, texname), 0, true, false);
-                        delete[] texname;
+                        md5shader s;
+                        copystring(s.name, start+1, min(size_t(end-start), sizeof(s.name)));
+                        s.meshes = group->meshes.length();
+                        ((md5meshgroup *)group)->loadshader(s);
                     }
                 }
                 else if(sscanf(buf, " numverts %d", &numverts)==1)
@@ -153,12 +157,69 @@ struct md5 : skelmodel, skelloader<md5>
 
     struct md5meshgroup : skelmeshgroup
     {
+        vector<md5shader> shaders;
+
         md5meshgroup() 
         {
         }
 
+        void loadshader(const md5shader &s)
+        {
+            part *p = loading->parts.last();
+            p->initskins(notexture, notexture, s.meshes);
+            skin &sk = p->skins.last();
+            sk.tex = textureload(makerelpath(dir, s.name), 0, true, false);
+            shaders.add(s);
+        }
+
+        bool loadmeshcache(const char *key, bool bones)
+        {
+            ucharbuf p;
+            uchar *buf = loadmodelcache(key, p);
+            if(!buf) return false;
+            bool loaded = skelmeshgroup::loadmeshcache<md5mesh>(p, bones);
+            if(loaded)
+            {
+                vector<md5shader> cached;
+                int numshaders = getmodelcache<int>(p);
+                loopi(numshaders)
+                {
+                    if(p.overread()) break;
+                    md5shader &s = cached.add();
+                    char *name = getmodelcachestring(p);
+                    copystring(s.name, name ? name : "");
+                    DELETEA(name);
+                    s.meshes = getmodelcache<int>(p);
+                }
+                if(p.overread() || p.remaining()) { clearmeshcache(bones); loaded = false; }
+                else loopv(cached) loadshader(cached[i]);
+            }
+            delete[] buf;
+            return loaded;
+        }
+
+        void savemeshcache(const char *key, bool bones)
+        {
+            stream *f = savemodelcache(key);
+            if(!f) return;
+            skelmeshgroup::savemeshcache(f, bones);
+            putmodelcache(f, shaders.length());
+            loopv(shaders)
+            {
+                putmodelcachestring(f, shaders[i].name);
+                putmodelcache(f, shaders[i].meshes);
+            }
+            delete f;
+        }
+
         bool loadmesh(const char *filename, float smooth)
         {
+            string cachekey;
+            uint salt = crc32(crc32(0, (const Bytef *)&skel->numbones, sizeof(int)), (const Bytef *)&smooth, sizeof(float));
+            bool bones = skel->numbones <= 0,
+                 cached = (!bones || skel->shared <= 1) && modelcachekey("md5mesh", filename, filename, salt, cachekey);
+            if(cached && loadmeshcache(cachekey, bones)) return true;
+
             stream *f = openfile(filename, "r");
             if(!f) return false;
 
@@ -257,6 +318,8 @@ struct md5 : skelmodel, skelloader<md5>
             
             sortblendcombos();
 
+            if(cached) savemeshcache(cachekey, bones);
+
             delete f;
             return true;
         }
@@ -266,6 +329,10 @@ struct md5 : skelmodel, skelloader<md5>
             skelanimspec *sa = skel->findskelanim(filename);
             if(sa) return sa;
 
+            string cachekey;
+            bool cached = modelcachekey("md5anim", filename, filename, animcachesalt(adjustments.getbuf(), adjustments.length()*sizeof(skeladjustment)), cachekey);
+            if(cached && (sa = loadanimcache(filename, cachekey))) return sa;
+
             stream *f = openfile(filename, "r");
             if(!f) return NULL;
 
@@ -376,6 +443,8 @@ struct md5 : skelmodel, skelloader<md5>
             DELETEA(animdata);
             delete f;
 
+            if(cached && sa) saveanimcache(cachekey, sa);
+
             return sa;
         }
 
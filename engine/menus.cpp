@@ -254,13 +254,13 @@ void guibutton(char *name, char *action, char *icon)
 void guiimage(char *path, char *action, float *scale, int *overlaid, char *alt)
 {
     if(!cgui) return;
-    Texture *t = textureload(path, 0, true, false);
+    Texture *t = asynctextureload(path);
     if(t==notexture)
     {
-        if(alt[0]) t = textureload(alt, 0, true, false);
+        if(alt[0]) t = asynctextureload(alt);
         if(t==notexture) return;
     }
-    int ret = cgui->image(t, *scale, *overlaid!=0);
+    int ret = cgui->image(t ? t : notexture, *scale, *overlaid!=0);
     if(ret&G3D_UP)
     {
         if(*action)
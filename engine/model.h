@@ -19,6 +19,7 @@ struct model
     virtual const char *name() const = 0;
     virtual int type() const = 0;
     virtual BIH *setBIH() { return 0; }
+    virtual BIH *newBIH() { return 0; }
     virtual bool envmapped() { return false; }
     virtual bool skeletal() const { return false; }
 
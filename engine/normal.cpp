@@ -1,4 +1,5 @@
 #include "engine.h"
+#include "SDL_thread.h"
 
 struct normalgroup
 {
@@ -34,35 +35,90 @@ VARR(lerpangle, 0, 44, 180);
 static float lerpthreshold = 0;
 static bool usetnormals = true;
 
-static int addnormal(const vec &key, const vec &surface)
+// normals are gathered per octree block, possibly on worker threads, and then
+// merged into the normal groups in octree order so the result matches a serial walk
+struct normalkey
 {
-    normalgroup &g = normalgroups.access(key, key);
-    normal &n = normals.add();
-    n.next = g.normals;
+    vec pos, surface;
+    int axis;
+};
+
+struct tnormalkey
+{
+    vec pos, ends[2];
+    float offset;
+    int normals[2];
+};
+
+struct normalblock
+{
+    cube *c;
+    ivec o;
+    int size;
+    bool done;
+    int numnormals;
+    vector<normalkey> normals;
+    vector<tnormalkey> tnormals;
+};
+
+static int addnormal(normalblock &b, const vec &key, const vec &surface)
+{
+    normalkey &n = b.normals.add();
+    n.pos = key;
     n.surface = surface;
-    return g.normals = normals.length()-1;
+    n.axis = -1;
+    return b.numnormals++;
 }
 
-static void addtnormal(const vec &key, float offset, int normal1, int normal2, normalgroup *group1, normalgroup *group2)
+static void addtnormal(normalblock &b, const vec &key, float offset, int normal1, int normal2, const vec &end1, const vec &end2)
 {
-    normalgroup &g = normalgroups.access(key, key);
-    tnormal &n = tnormals.add();
-    n.next = g.tnormals;
+    tnormalkey &n = b.tnormals.add();
+    n.pos = key;
     n.offset = offset;
     n.normals[0] = normal1;
     n.normals[1] = normal2;
-    n.groups[0] = group1;
-    n.groups[1] = group2;
-    g.tnormals = tnormals.length()-1;
+    n.ends[0] = end1;
+    n.ends[1] = end2;
 }
 
-static int addnormal(const vec &key, int axis)
+static int addnormal(normalblock &b, const vec &key, int axis)
 {
-    normalgroup &g = normalgroups.access(key, key);
-    g.flat += 1<<(4*axis);
+    normalkey &n = b.normals.add();
+    n.pos = key;
+    n.axis = axis;
     return axis - 6;
 }
 
+static void mergenormals(normalblock &b)
+{
+    int base = normals.length();
+    loopv(b.normals)
+    {
+        normalkey &k = b.normals[i];
+        normalgroup &g = normalgroups.access(k.pos, k.pos);
+        if(k.axis >= 0) { g.flat += 1<<(4*k.axis); continue; }
+        normal &n = normals.add();
+        n.next = g.normals;
+        n.surface = k.surface;
+        g.normals = normals.length()-1;
+    }
+    loopv(b.tnormals)
+    {
+        tnormalkey &k = b.tnormals[i];
+        normalgroup *group1 = normalgroups.access(k.ends[0]), *group2 = normalgroups.access(k.ends[1]);
+        normalgroup &g = normalgroups.access(k.pos, k.pos);
+        tnormal &n = tnormals.add();
+        n.next = g.tnormals;
+        n.offset = k.offset;
+        loopj(2) n.normals[j] = k.normals[j] >= 0 ? base + k.normals[j] : k.normals[j];
+        n.groups[0] = group1;
+        n.groups[1] = group2;
+        g.tnormals = tnormals.length()-1;
+    }
+    { vector<normalkey> tmp; tmp.move(b.normals); }
+    { vector<tnormalkey> tmp; tmp.move(b.tnormals); }
+}
+
 static inline void findnormal(const normalgroup &g, const vec &surface, vec &v)
 {
     v = vec(0, 0, 0);
@@ -126,7 +182,7 @@ void findnormal(const vec &key, const vec &surface, vec &v)
 VARR(lerpsubdiv, 0, 2, 4);
 VARR(lerpsubdivsize, 4, 4, 128);
 
-static uint progress = 0;
+static volatile uint progress = 0;
 
 void show_addnormals_progress()
 {
@@ -134,15 +190,15 @@ void show_addnormals_progress()
     renderprogress(bar1, "computing normals...");
 }
 
-void addnormals(cube &c, const ivec &o, int size)
+static void addnormals(normalblock &b, cube &c, const ivec &o, int size)
 {
-    CHECK_CALCLIGHT_PROGRESS(return, show_addnormals_progress);
+    if(calclight_canceled) return;
 
     if(c.children)
     {
         progress++;
         size >>= 1;
-        loopi(8) addnormals(c.children[i], ivec(i, o.x, o.y, o.z, size), size);
+        loopi(8) addnormals(b, c.children[i], ivec(i, o.x, o.y, o.z, size), size);
         return;
     }
     else if(isempty(c)) return;
@@ -152,7 +208,6 @@ void addnormals(cube &c, const ivec &o, int size)
     int tj = usetnormals && c.ext ? c.ext->tjoints : -1, vis;
     loopi(6) if((vis = visibletris(c, i, o.x, o.y, o.z, size)))
     {
-        CHECK_CALCLIGHT_PROGRESS(return, show_addnormals_progress);
         if(c.texture[i] == DEFAULT_SKY) continue;
 
         vec planes[2];
@@ -188,15 +243,15 @@ void addnormals(cube &c, const ivec &o, int size)
             if(convex) planes[numplanes++].cross(pos[0], pos[2], pos[3]).normalize();
         }
 
-        if(!numplanes) loopk(numverts) norms[k] = addnormal(pos[k], i);
-        else if(numplanes==1) loopk(numverts) norms[k] = addnormal(pos[k], planes[0]);
+        if(!numplanes) loopk(numverts) norms[k] = addnormal(b, pos[k], i);
+        else if(numplanes==1) loopk(numverts) norms[k] = addnormal(b, pos[k], planes[0]);
         else 
         { 
             vec avg = vec(planes[0]).add(planes[1]).normalize();
-            norms[0] = addnormal(pos[0], avg);
-            norms[1] = addnormal(pos[1], planes[0]);
-            norms[2] = addnormal(pos[2], avg);
-            for(int k = 3; k < numverts; k++) norms[k] = addnormal(pos[k], planes[1]);
+            norms[0] = addnormal(b, pos[0], avg);
+            norms[1] = addnormal(b, pos[1], planes[0]);
+            norms[2] = addnormal(b, pos[2], avg);
+            for(int k = 3; k < numverts; k++) norms[k] = addnormal(b, pos[k], planes[1]);
         }
 
         while(tj >= 0 && tjoints[tj].edge < i*(MAXFACEVERTS+1)) tj = tjoints[tj].next;
@@ -220,21 +275,109 @@ void addnormals(cube &c, const ivec &o, int size)
                 if(t.edge != edge) break;
                 float offset = (t.offset - offset1) * doffset;
                 vec tpos = d.tovec().mul(t.offset/8.0f).add(o); 
-                addtnormal(tpos, offset, norms[e1], norms[e2], normalgroups.access(v1), normalgroups.access(v2));
+                addtnormal(b, tpos, offset, norms[e1], norms[e2], v1, v2);
                 tj = t.next;
             }
         }
     }
 }
 
-void calcnormals(bool lerptjoints)
+static vector<normalblock> normalblocks;
+static int nextnormalblock = 0;
+static SDL_mutex *normalmutex = NULL;
+static SDL_cond *normalcond = NULL;
+
+static void gennormalblocks(cube *c, const ivec &co, int size, int blocksize)
+{
+    loopi(8)
+    {
+        ivec o(i, co.x, co.y, co.z, size);
+        if(c[i].children && size > blocksize)
+        {
+            progress++;
+            gennormalblocks(c[i].children, o, size>>1, blocksize);
+        }
+        else if(c[i].children || !isempty(c[i]))
+        {
+            normalblock &b = normalblocks.add();
+            b.c = &c[i];
+            b.o = o;
+            b.size = size;
+            b.done = false;
+            b.numnormals = 0;
+        }
+    }
+}
+
+static int normalthread(void *data)
+{
+    SDL_LockMutex(normalmutex);
+    while(!calclight_canceled && nextnormalblock < normalblocks.length())
+    {
+        normalblock &b = normalblocks[nextnormalblock++];
+        SDL_UnlockMutex(normalmutex);
+        addnormals(b, *b.c, b.o, b.size);
+        SDL_LockMutex(normalmutex);
+        b.done = true;
+        SDL_CondBroadcast(normalcond);
+    }
+    SDL_UnlockMutex(normalmutex);
+    return 0;
+}
+
+void calcnormals(bool lerptjoints, int numthreads)
 {
     if(!lerpangle) return;
     usetnormals = lerptjoints; 
     if(usetnormals) findtjoints();
     lerpthreshold = cos(lerpangle*RAD) - 1e-5f; 
     progress = 1;
-    loopi(8) addnormals(worldroot[i], ivec(i, 0, 0, 0, worldsize/2), worldsize/2);
+    gennormalblocks(worldroot, ivec(0, 0, 0), worldsize/2, max(worldsize>>3, 1));
+    numthreads = min(numthreads, normalblocks.length());
+    vector<SDL_Thread *> threads;
+    if(numthreads > 1)
+    {
+        if(!normalmutex) normalmutex = SDL_CreateMutex();
+        if(!normalcond) normalcond = SDL_CreateCond();
+        nextnormalblock = 0;
+        if(normalmutex && normalcond) loopi(numthreads)
+        {
+            SDL_Thread *thread = SDL_CreateThread(normalthread, NULL);
+            if(thread) threads.add(thread);
+        }
+    }
+    if(threads.empty())
+    {
+        loopv(normalblocks)
+        {
+            CHECK_CALCLIGHT_PROGRESS(break, show_addnormals_progress);
+            normalblock &b = normalblocks[i];
+            addnormals(b, *b.c, b.o, b.size);
+            mergenormals(b);
+        }
+    }
+    else
+    {
+        loopv(normalblocks)
+        {
+            normalblock &b = normalblocks[i];
+            SDL_LockMutex(normalmutex);
+            while(!b.done && !calclight_canceled)
+            {
+                SDL_CondWaitTimeout(normalcond, normalmutex, 250);
+                if(b.done) break;
+                SDL_UnlockMutex(normalmutex);
+                CHECK_CALCLIGHT_PROGRESS(, show_addnormals_progress);
+                SDL_LockMutex(normalmutex);
+            }
+            SDL_UnlockMutex(normalmutex);
+            if(calclight_canceled) break;
+            mergenormals(b);
+            CHECK_CALCLIGHT_PROGRESS(break, show_addnormals_progress);
+        }
+        loopv(threads) SDL_WaitThread(threads[i], NULL);
+    }
+    normalblocks.shrink(0);
 }
 
 void clearnormals()
@@ -22,11 +22,69 @@ struct obj : vertmodel, vertloader<obj>
             }
         }
 
+        bool loadmeshcache(const char *key)
+        {
+            ucharbuf p;
+            uchar *buf = loadmodelcache(key, p);
+            if(!buf) return false;
+            int nummeshes = getmodelcache<int>(p);
+            loopi(nummeshes)
+            {
+                if(p.overread()) break;
+                vertmesh &m = *new vertmesh;
+                m.group = this;
+                meshes.add(&m);
+                m.name = getmodelcachestring(p);
+                m.numverts = getmodelcache<int>(p);
+                m.numtris = getmodelcache<int>(p);
+                m.verts = getmodelcachearray<vert>(p, m.numverts);
+                m.tcverts = getmodelcachearray<tcvert>(p, m.numverts);
+                m.tris = getmodelcachearray<tri>(p, m.numtris);
+            }
+            bool loaded = !p.overread() && !p.remaining() && meshes.length() == nummeshes;
+            loopv(meshes)
+            {
+                vertmesh &m = *(vertmesh *)meshes[i];
+                if(!loaded) break;
+                loopj(m.numtris) loopk(3) if(m.tris[j].vert[k] >= m.numverts) { loaded = false; break; }
+            }
+            if(!loaded) meshes.deletecontents();
+            delete[] buf;
+            return loaded;
+        }
+
+        void savemeshcache(const char *key)
+        {
+            stream *f = savemodelcache(key);
+            if(!f) return;
+            putmodelcache(f, meshes.length());
+            loopv(meshes)
+            {
+                vertmesh &m = *(vertmesh *)meshes[i];
+                putmodelcachestring(f, m.name);
+                putmodelcache(f, m.numverts);
+                putmodelcache(f, m.numtris);
+                f->write(m.verts, m.numverts*sizeof(vert));
+                f->write(m.tcverts, m.numverts*sizeof(tcvert));
+                f->write(m.tris, m.numtris*sizeof(tri));
+            }
+            delete f;
+        }
+
         bool load(const char *filename, float smooth)
         {
             int len = strlen(filename);
             if(len < 4 || strcasecmp(&filename[len-4], ".obj")) return false;
 
+            string cachekey;
+            bool cached = modelcachekey("objmesh", filename, filename, crc32(0, (const Bytef *)&smooth, sizeof(float)), cachekey);
+            if(cached && loadmeshcache(cachekey))
+            {
+                name = newstring(filename);
+                numframes = 1;
+                return true;
+            }
+
             stream *file = openfile(filename, "rb");
             if(!file) return false;
 
@@ -156,6 +214,8 @@ struct obj : vertmodel, vertloader<obj>
 
             delete file;
 
+            if(cached) savemeshcache(cachekey);
+
             return true;
         }
     };
@@ -238,13 +238,15 @@ struct undoblock // undo header, all data sits in payload
 {
     undoblock *prev, *next;
     int size, timestamp, numents; // if numents is 0, is a cube undo record, otherwise an entity undo record
+    int packedlen, unpackedlen;   // if packedlen is non-zero, cubes are stored compressed after the grid map
 
     block3 *block() { return (block3 *)(this + 1); }
     int *gridmap()
     {
         block3 *ub = block();
-        return (int *)(ub->c() + ub->size());
+        return packedlen ? (int *)(ub + 1) : (int *)(ub->c() + ub->size());
     }
+    uchar *packeddata() { return (uchar *)(gridmap() + block()->size()); }
     undoent *ents() { return (undoent *)(this + 1); }
 };
 
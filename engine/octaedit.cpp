@@ -556,6 +556,7 @@ void changed(const block3 &sel, bool commit = true)
         b.s[i] -= 2;
     }
     haschanged = true;
+    pvschanged(b.o, b.s);
 
     if(commit) commitchanges();
 }
@@ -608,15 +609,40 @@ void selgridmap(selinfo &sel, int *g)                           // generates a m
     loopxyz(sel, -sel.grid, (*g++ = lusize, (void)c));
 }
 
+template<class B> static void packcube(cube &c, B &buf);
+template<class B> static void unpackcube(cube &c, B &buf);
+static bool compresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen, int maxlen = 1<<16, int level = Z_BEST_COMPRESSION);
+static bool uncompresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen, int maxlen = 1<<20);
+
 void freeundo(undoblock *u)
 {
-    if(!u->numents) freeblock(u->block(), false);
+    if(!u->numents && !u->packedlen) freeblock(u->block(), false);
     delete[] (uchar *)u;
 }
 
+static inline void pasteundocube(ucharbuf &buf, cube &c)
+{
+    cube src;
+    memset(&src, 0, sizeof(src));
+    unpackcube(src, buf);
+    discardchildren(c);
+    c = src;
+}
+
 void pasteundo(undoblock *u)
 {
     if(u->numents) pasteundoents(u);
+    else if(u->packedlen)
+    {
+        uchar *data = NULL;
+        int len = u->unpackedlen;
+        if(!uncompresseditinfo(u->packeddata(), u->packedlen, data, len, int(compressBound(len)))) return;
+        ucharbuf buf(data, len);
+        block3 *b = u->block();
+        int *g = u->gridmap();
+        loopxyz(*b, *g++, pasteundocube(buf, c));
+        delete[] data;
+    }
     else
     {
         block3 *b = u->block();
@@ -629,6 +655,7 @@ void pasteundo(undoblock *u)
 static inline int undosize(undoblock *u)
 {
     if(u->numents) return u->numents*sizeof(undoent);
+    else if(u->packedlen) return u->block()->size()*sizeof(int) + u->packedlen;
     else
     {
         block3 *b = u->block();
@@ -676,6 +703,13 @@ struct undolist
         else first = NULL;
         return u;
     }
+    void replace(undoblock *u, undoblock *r)
+    {
+        r->prev = u->prev;
+        r->next = u->next;
+        if(r->prev) r->prev->next = r; else first = r;
+        if(r->next) r->next->prev = r; else last = r;
+    }
 };
 
 undolist undos, redos;
@@ -711,6 +745,7 @@ undoblock *newundocube(selinfo &s)
     if(blocksize <= 0 || blocksize > (undomegs<<20)) return NULL;
     undoblock *u = (undoblock *)new uchar[sizeof(undoblock) + blocksize + selgridsize];
     u->numents = 0;
+    u->packedlen = u->unpackedlen = 0;
     block3 *b = (block3 *)(u + 1);
     blockcopy(s, -s.grid, b);
     int *g = (int *)((uchar *)b + blocksize);
@@ -718,6 +753,30 @@ undoblock *newundocube(selinfo &s)
     return u;
 }
 
+VARP(undocompress, 0, 1, 9);                            // zlib level for stored undos, 0 keeps full cube copies
+
+undoblock *newpackedundo(selinfo &s)                    // packs cubes straight from the world, unpacked on undo/redo
+{
+    if(!undocompress) return newundocube(s);
+    int ssize = s.size();
+    if(ssize <= 0 || ssize > (undomegs<<20)/int(sizeof(cube))) return NULL;
+    vector<uchar> buf;
+    loopxyz(s, -s.grid, packcube(c, buf));
+    uchar *packed = NULL;
+    int packedlen = 0;
+    if(!compresseditinfo(buf.getbuf(), buf.length(), packed, packedlen, undomegs<<20, undocompress)) return NULL;
+    undoblock *u = (undoblock *)new uchar[sizeof(undoblock) + sizeof(block3) + ssize*sizeof(int) + packedlen];
+    u->numents = 0;
+    u->packedlen = packedlen;
+    u->unpackedlen = buf.length();
+    block3 *b = u->block();
+    *b = s;
+    selgridmap(s, u->gridmap());
+    memcpy(u->packeddata(), packed, packedlen);
+    delete[] packed;
+    return u;
+}
+
 void addundo(undoblock *u)
 {
     u->size = undosize(u);
@@ -732,7 +791,7 @@ VARP(nompedit, 0, 1, 1);
 void makeundoex(selinfo &s)
 {
     if(nompedit && multiplayer(false)) return;
-    undoblock *u = newundocube(s);
+    undoblock *u = newpackedundo(s);
     if(u) addundo(u);
 }
 
@@ -760,7 +819,7 @@ void swapundo(undolist &a, undolist &b, const char *s)
 			l.s = ub->s;
 			l.grid = ub->grid;
 			l.orient = ub->orient;
-            r = newundocube(l);
+            r = newpackedundo(l);
 		}
         if(r)
         {
@@ -861,12 +920,12 @@ static bool unpackblock(block3 *&b, B &buf)
     return true;
 }
 
-static bool compresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen)
+static bool compresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen, int maxlen, int level)
 {
     uLongf len = compressBound(inlen);
-    if(len > (1<<20)) return false;
+    if(len > uLongf(max(maxlen, 1<<20))) return false;
     outbuf = new uchar[len];
-    if(compress2((Bytef *)outbuf, &len, (const Bytef *)inbuf, inlen, Z_BEST_COMPRESSION) != Z_OK || len > (1<<16))
+    if(compress2((Bytef *)outbuf, &len, (const Bytef *)inbuf, inlen, level) != Z_OK || len > uLongf(maxlen))
     {
         delete[] outbuf;
         outbuf = NULL;
@@ -876,9 +935,9 @@ static bool compresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int
     return true;
 }
 
-static bool uncompresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen)
+static bool uncompresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen, int maxlen)
 {
-    if(compressBound(outlen) > (1<<20)) return false;
+    if(compressBound(outlen) > uLong(max(maxlen, 1<<20))) return false;
     uLongf len = outlen;
     outbuf = new uchar[len];
     if(uncompress((Bytef *)outbuf, &len, (const Bytef *)inbuf, inlen) != Z_OK)
@@ -1058,6 +1117,73 @@ COMMANDN(redo, editredo, "");
 
 static VSlot *editingvslot = NULL;
 
+static bool compactpackedcube(uchar *&p, const uchar *end, bool &remapped) // remaps vslots in place in a packcube stream
+{
+    if(p >= end) return false;
+    if(*p == 0xFF)
+    {
+        p++;
+        loopi(8) if(!compactpackedcube(p, end, remapped)) return false;
+        return true;
+    }
+    const int texoffset = 2 + sizeof(((cube *)NULL)->edges);
+    if(end - p < texoffset + 6*2) return false;
+    p += texoffset;
+    loopi(6)
+    {
+        int tex = p[0] | (p[1]<<8), index = tex;
+        compactvslot(index);
+        if(index != tex) { p[0] = index&0xFF; p[1] = index>>8; remapped = true; }
+        p += 2;
+    }
+    return true;
+}
+
+static undoblock *compactpackedundo(undoblock *u)
+{
+    uchar *data = NULL;
+    int len = u->unpackedlen;
+    if(!uncompresseditinfo(u->packeddata(), u->packedlen, data, len, int(compressBound(len)))) return u;
+    bool remapped = false;
+    uchar *p = data;
+    block3 *b = u->block();
+    loopi(b->size()) if(!compactpackedcube(p, data + len, remapped)) break;
+    uchar *packed = NULL;
+    int packedlen = 0;
+    if(!remapped || !compresseditinfo(data, len, packed, packedlen, int(compressBound(len)), undocompress ? undocompress : Z_BEST_SPEED))
+    {
+        delete[] data;
+        return u;
+    }
+    delete[] data;
+    int gridsize = b->size()*sizeof(int);
+    undoblock *r = (undoblock *)new uchar[sizeof(undoblock) + sizeof(block3) + gridsize + packedlen];
+    r->size = u->size;
+    r->timestamp = u->timestamp;
+    r->numents = 0;
+    r->packedlen = packedlen;
+    r->unpackedlen = len;
+    *r->block() = *b;
+    memcpy(r->gridmap(), u->gridmap(), gridsize);
+    memcpy(r->packeddata(), packed, packedlen);
+    delete[] packed;
+    return r;
+}
+
+static void compactundovslots(undolist &l)
+{
+    for(undoblock *u = l.first; u; u = u->next)
+    {
+        if(u->numents) continue;
+        if(!u->packedlen) { compactvslots(u->block()->c(), u->block()->size()); continue; }
+        undoblock *r = compactpackedundo(u);
+        if(r == u) continue;
+        l.replace(u, r);
+        freeundo(u);
+        u = r;
+    }
+}
+
 void compacteditvslots()
 {
     if(editingvslot && editingvslot->layer) compactvslot(editingvslot->layer);
@@ -1066,12 +1192,8 @@ void compacteditvslots()
         editinfo *e = editinfos[i];
         compactvslots(e->copy->c(), e->copy->size());
     }
-    for(undoblock *u = undos.first; u; u = u->next)
-        if(!u->numents)
-            compactvslots(u->block()->c(), u->block()->size());
-    for(undoblock *u = redos.first; u; u = u->next)
-        if(!u->numents)
-            compactvslots(u->block()->c(), u->block()->size());
+    compactundovslots(undos);
+    compactundovslots(redos);
 }
 
 ///////////// height maps ////////////////
@@ -1763,6 +1763,32 @@ void octarender()                               // creates va s for all leaf cub
     visibleva = NULL;
 }
 
+static void findtextures(cube *c, vector<int> &texs, vector<uchar> &seen)
+{
+    loopi(8)
+    {
+        if(c[i].children) findtextures(c[i].children, texs, seen);
+        else if(!isempty(c[i])) loopj(6)
+        {
+            int tex = c[i].texture[j];
+            if(seen[tex]) continue;
+            seen[tex] = 1;
+            texs.add(tex);
+        }
+    }
+}
+
+// starts decoding the textures of a freshly loaded map in the order the octree will ask for them
+static void prefetchmaptextures()
+{
+    vector<int> texs;
+    vector<uchar> seen;
+    seen.pad(0x10000);
+    memset(seen.getbuf(), 0, seen.length());
+    findtextures(worldroot, texs, seen);
+    prefetchtextures(texs);
+}
+
 void precachetextures()
 {
     vector<int> texs;
@@ -1790,8 +1816,13 @@ void allchanged(bool load)
     entitiesinoctanodes();
     tjoints.setsize(0);
     if(filltjoints) findtjoints();
+    if(load) prefetchmaptextures();
     octarender();
-    if(load) precachetextures();
+    if(load)
+    {
+        precachetextures();
+        finishprefetchtextures();
+    }
     setupmaterials();
     invalidatepostfx();
     updatevabbs(true);
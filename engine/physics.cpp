@@ -186,7 +186,7 @@ static float disttooutsideent(const vec &o, const vec &ray, float radius, int mo
 }
 
 // optimized shadow version
-static float shadowent(octaentities *oc, octaentities *last, const vec &o, const vec &ray, float radius, int mode, extentity *t)
+static float shadowent(octaentities *oc, octaentities *last, const vec &o, const vec &ray, float radius, int mode, extentity *t, extentity **hit = NULL)
 {
     float dist = 1e16f, f = 0.0f;
     if(oc == last) return dist;
@@ -196,7 +196,7 @@ static float shadowent(octaentities *oc, octaentities *last, const vec &o, const
         extentity &e = *ents[oc->mapmodels[i]];
         if(!e.inoctanode || &e==t) continue;
         if(!mmintersect(e, o, ray, radius, mode, f)) continue;
-        if(f>0 && f<dist) dist = f;
+        if(f>0 && f<dist) { dist = f; if(hit) *hit = &e; }
     }
     return dist;
 }
@@ -357,12 +357,39 @@ float shadowray(const vec &o, const vec &ray, float radius, int mode, extentity
 
 // thread safe version
 
+// recent occluders are remembered per light (ray origin, or direction for parallel rays), so neighbouring
+// lumels shadowed by the same cube or mapmodel can skip the octree walk entirely
+
+#define SHADOWOCCLUDERSETS 16
+#define SHADOWOCCLUDERS 4
+
+struct shadowoccluder
+{
+    cube *c;
+    extentity *e;
+    ivec o;
+    int size;
+};
+
+struct shadowoccluderset
+{
+    vec anchor;
+    int mode;
+    extentity *t;
+    uint lastused;
+    int numoccluders;
+    shadowoccluder occluders[SHADOWOCCLUDERS];
+};
+
 struct ShadowRayCache
 {
     clipplanes clipcache[MAXCLIPPLANES];
     int version;
+    shadowoccluderset occluders[SHADOWOCCLUDERSETS];
+    int numoccluders;
+    uint usage, hits, lookups;
 
-    ShadowRayCache() : version(-1) {}
+    ShadowRayCache() : version(-1), numoccluders(0), usage(0), hits(0), lookups(0) {}
 };
 
 ShadowRayCache *newshadowraycache() { return new ShadowRayCache; }
@@ -377,29 +404,165 @@ void resetshadowraycache(ShadowRayCache *cache)
         memset(cache->clipcache, 0, sizeof(cache->clipcache));
         cache->version = 1;
     }
+    cache->numoccluders = 0;
+    cache->usage = cache->hits = cache->lookups = 0;
+}
+
+void getshadowraycachestats(ShadowRayCache *cache, uint &hits, uint &lookups)
+{
+    hits = cache->hits;
+    lookups = cache->lookups;
+}
+
+VAR(shadowoccluders, 0, 1, 1);
+
+static inline const vec &shadowanchor(const vec &o, const vec &ray, float radius)
+{
+    return radius >= 1e15f ? ray : o;
+}
+
+static shadowoccluderset *findshadowoccluders(ShadowRayCache *cache, const vec &anchor, int mode, extentity *t)
+{
+    // a sky face in front of a remembered occluder would let the ray through, so those rays always walk the octree
+    if(!shadowoccluders || mode&RAY_SKIPSKY) return NULL;
+    loopi(cache->numoccluders)
+    {
+        shadowoccluderset &s = cache->occluders[i];
+        if(s.anchor == anchor && s.mode == mode && s.t == t) { s.lastused = ++cache->usage; return &s; }
+    }
+    return NULL;
 }
 
+static void addshadowoccluder(ShadowRayCache *cache, const vec &anchor, int mode, extentity *t, cube *c, extentity *e, const ivec &o, int size)
+{
+    if(!shadowoccluders || mode&RAY_SKIPSKY) return;
+    shadowoccluderset *s = findshadowoccluders(cache, anchor, mode, t);
+    if(!s)
+    {
+        if(cache->numoccluders < SHADOWOCCLUDERSETS) s = &cache->occluders[cache->numoccluders++];
+        else
+        {
+            s = &cache->occluders[0];
+            loopi(SHADOWOCCLUDERSETS) if(cache->occluders[i].lastused < s->lastused) s = &cache->occluders[i];
+        }
+        s->anchor = anchor;
+        s->mode = mode;
+        s->t = t;
+        s->lastused = ++cache->usage;
+        s->numoccluders = 0;
+    }
+    loopi(s->numoccluders) if(s->occluders[i].c == c && s->occluders[i].e == e) return;
+    if(s->numoccluders < SHADOWOCCLUDERS) s->numoccluders++;
+    memmove(&s->occluders[1], &s->occluders[0], (s->numoccluders-1)*sizeof(shadowoccluder));
+    shadowoccluder &oc = s->occluders[0];
+    oc.c = c;
+    oc.e = e;
+    oc.o = o;
+    oc.size = size;
+}
+
+static inline bool addshadowent(ShadowRayCache *cache, const vec &anchor, int mode, extentity *t, extentity *e)
+{
+    if(e) addshadowoccluder(cache, anchor, mode, t, NULL, e, ivec(0, 0, 0), 0);
+    return true;
+}
+
+static inline bool intersectshadowoccluder(const clipplanes &p, const vec &v, const vec &ray, const vec &invray, float &dist)
+{
+    INTERSECTPLANES(, return false);
+    INTERSECTBOX(, return false);
+    if(exitdist < 0) return false;
+    dist = max(enterdist+0.1f, 0.0f);
+    return true;
+}
+
+static float testshadowoccluders(ShadowRayCache *cache, shadowoccluderset *s, const vec &v, const vec &ray, float radius, int mode)
+{
+    cache->lookups++;
+    vec invray(ray.x ? 1/ray.x : 1e16f, ray.y ? 1/ray.y : 1e16f, ray.z ? 1/ray.z : 1e16f);
+    loopj(s->numoccluders)
+    {
+        shadowoccluder &oc = s->occluders[j];
+        float hitdist = 1e16f;
+        if(oc.e)
+        {
+            float f = 0;
+            if(mmintersect(*oc.e, v, ray, radius, mode, f) && f > 0) hitdist = f;
+        }
+        else if(isentirelysolid(*oc.c))
+        {
+            float enterdist = -1e16f, exitdist = 1e16f;
+            loopi(3)
+            {
+                if(ray[i])
+                {
+                    float t1 = (oc.o[i] - v[i])*invray[i], t2 = (oc.o[i] + oc.size - v[i])*invray[i];
+                    enterdist = max(enterdist, min(t1, t2));
+                    exitdist = min(exitdist, max(t1, t2));
+                }
+                else if(v[i] < oc.o[i] || v[i] > oc.o[i] + oc.size) { exitdist = -1; break; }
+            }
+            if(enterdist <= exitdist && exitdist >= 0) hitdist = max(enterdist, 0.0f);
+        }
+        else
+        {
+            clipplanes &p = cache->clipcache[int(oc.c - worldroot)&(MAXCLIPPLANES-1)];
+            if(p.owner != oc.c || p.version != cache->version) { p.owner = oc.c; p.version = cache->version; genclipplanes(*oc.c, oc.o.x, oc.o.y, oc.o.z, oc.size, p, false); }
+            float f = 0;
+            if(intersectshadowoccluder(p, v, ray, invray, f)) hitdist = f;
+        }
+        if(hitdist < radius)
+        {
+            if(j) swap(s->occluders[0], s->occluders[j]);
+            cache->hits++;
+            return hitdist;
+        }
+    }
+    return 1e16f;
+}
+
+#define SHADOWENTHIT(oc, last, o, ray, radius, mode, t) shadowent(oc, last, o, ray, radius, mode, t, &entoccluder)
+
 float shadowray(ShadowRayCache *cache, const vec &o, const vec &ray, float radius, int mode, extentity *t)
 {
+    const vec &anchor = shadowanchor(o, ray, radius);
+    shadowoccluderset *occluders = findshadowoccluders(cache, anchor, mode, t);
+    if(occluders)
+    {
+        float odist = testshadowoccluders(cache, occluders, o, ray, radius, mode);
+        if(odist < radius) return odist;
+    }
+
     INITRAYCUBE;
     CHECKINSIDEWORLD;
 
+    extentity *entoccluder = NULL;
     int side = O_BOTTOM, x = int(v.x), y = int(v.y), z = int(v.z);
     for(;;)
     {
-        DOWNOCTREE(shadowent, true);
+        DOWNOCTREE(SHADOWENTHIT, addshadowent(cache, anchor, mode, t, entoccluder));
 
         cube &c = *lc;
         ivec lo(x&(~0<<lshift), y&(~0<<lshift), z&(~0<<lshift));
 
         if(!isempty(c) && !(c.material&MAT_ALPHA))
         {
-            if(isentirelysolid(c)) return c.texture[side]==DEFAULT_SKY && mode&RAY_SKIPSKY ? radius : dist;
+            if(isentirelysolid(c))
+            {
+                if(c.texture[side]==DEFAULT_SKY && mode&RAY_SKIPSKY) return radius;
+                addshadowoccluder(cache, anchor, mode, t, &c, NULL, lo, 1<<lshift);
+                return dist;
+            }
             clipplanes &p = cache->clipcache[int(&c - worldroot)&(MAXCLIPPLANES-1)];
             if(p.owner != &c || p.version != cache->version) { p.owner = &c; p.version = cache->version; genclipplanes(c, lo.x, lo.y, lo.z, 1<<lshift, p, false); }
             INTERSECTPLANES(side = p.side[i], goto nextcube);
             INTERSECTBOX(side = (i<<1) + 1 - lsizemask[i], goto nextcube);
-            if(exitdist >= 0) return c.texture[side]==DEFAULT_SKY && mode&RAY_SKIPSKY ? radius : dist+max(enterdist+0.1f, 0.0f);
+            if(exitdist >= 0)
+            {
+                if(c.texture[side]==DEFAULT_SKY && mode&RAY_SKIPSKY) return radius;
+                addshadowoccluder(cache, anchor, mode, t, &c, NULL, lo, 1<<lshift);
+                return dist+max(enterdist+0.1f, 0.0f);
+            }
         }
 
     nextcube:
@@ -411,6 +574,238 @@ float shadowray(ShadowRayCache *cache, const vec &o, const vec &ray, float radiu
     }
 }
 
+// packet version for coherent lightmap rays, traces up to SHADOWRAYPACKET rays together through the octree
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SHADOWRAYSSE
+#include <xmmintrin.h>
+#endif
+
+struct shadowpacket
+{
+    float vx[SHADOWRAYPACKET], vy[SHADOWRAYPACKET], vz[SHADOWRAYPACKET],
+          rx[SHADOWRAYPACKET], ry[SHADOWRAYPACKET], rz[SHADOWRAYPACKET],
+          ix[SHADOWRAYPACKET], iy[SHADOWRAYPACKET], iz[SHADOWRAYPACKET],
+          dist[SHADOWRAYPACKET], enter[SHADOWRAYPACKET];
+    int side[SHADOWRAYPACKET];
+    ivec pos[SHADOWRAYPACKET], lastlo[SHADOWRAYPACKET], lsizemask[SHADOWRAYPACKET];
+    octaentities *oclast[SHADOWRAYPACKET];
+};
+
+#ifdef SHADOWRAYSSE
+static inline __m128 selectps(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+static inline int intersectshadowpacket(const clipplanes &p, shadowpacket &s, int group)
+{
+    __m128 vx = _mm_loadu_ps(s.vx), vy = _mm_loadu_ps(s.vy), vz = _mm_loadu_ps(s.vz),
+           rx = _mm_loadu_ps(s.rx), ry = _mm_loadu_ps(s.ry), rz = _mm_loadu_ps(s.rz),
+           enterdist = _mm_set1_ps(-1e16f), exitdist = _mm_set1_ps(1e16f), miss = _mm_setzero_ps(), zero = _mm_setzero_ps(),
+           side = _mm_setr_ps(float(s.side[0]), float(s.side[1]), float(s.side[2]), float(s.side[3]));
+    loopi(p.size)
+    {
+        const plane &pl = p.p[i];
+        __m128 pdist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl.x), vx), _mm_mul_ps(_mm_set1_ps(pl.y), vy)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl.z), vz), _mm_set1_ps(pl.offset))),
+               facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(pl.x), rx), _mm_mul_ps(_mm_set1_ps(pl.y), ry)), _mm_mul_ps(_mm_set1_ps(pl.z), rz)),
+               neg = _mm_cmplt_ps(facing, zero), pos = _mm_cmpgt_ps(facing, zero),
+               t = _mm_div_ps(pdist, _mm_sub_ps(zero, selectps(_mm_or_ps(neg, pos), facing, _mm_set1_ps(-1)))),
+               entering = _mm_and_ps(neg, _mm_cmpgt_ps(t, enterdist)),
+               exiting = _mm_and_ps(pos, _mm_cmplt_ps(t, exitdist));
+        enterdist = selectps(entering, t, enterdist);
+        side = selectps(entering, _mm_set1_ps(float(p.side[i])), side);
+        exitdist = selectps(exiting, t, exitdist);
+        miss = _mm_or_ps(miss, _mm_andnot_ps(_mm_or_ps(neg, pos), _mm_cmpgt_ps(pdist, zero)));
+    }
+    const __m128 v[3] = { vx, vy, vz }, r[3] = { rx, ry, rz }, inv[3] = { _mm_loadu_ps(s.ix), _mm_loadu_ps(s.iy), _mm_loadu_ps(s.iz) };
+    loop(k, 3)
+    {
+        __m128 nonzero = _mm_cmpneq_ps(r[k], zero),
+               prad = _mm_mul_ps(_mm_set1_ps(p.r[k]), inv[k]),
+               pdist = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(p.o[k]), v[k]), inv[k]);
+        prad = _mm_max_ps(prad, _mm_sub_ps(zero, prad));
+        __m128 pmin = _mm_sub_ps(pdist, prad), pmax = _mm_add_ps(pdist, prad),
+               entering = _mm_and_ps(nonzero, _mm_cmpgt_ps(pmin, enterdist)),
+               exiting = _mm_and_ps(nonzero, _mm_cmplt_ps(pmax, exitdist)),
+               boxside = _mm_sub_ps(_mm_set1_ps(float((k<<1) + 1)), _mm_and_ps(_mm_cmpgt_ps(inv[k], zero), _mm_set1_ps(1)));
+        enterdist = selectps(entering, pmin, enterdist);
+        side = selectps(entering, boxside, side);
+        exitdist = selectps(exiting, pmax, exitdist);
+        miss = _mm_or_ps(miss, _mm_andnot_ps(nonzero, _mm_or_ps(_mm_cmplt_ps(v[k], _mm_set1_ps(p.o[k]-p.r[k])), _mm_cmpgt_ps(v[k], _mm_set1_ps(p.o[k]+p.r[k])))));
+    }
+    miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmpgt_ps(enterdist, exitdist), _mm_cmplt_ps(exitdist, zero)));
+    _mm_storeu_ps(s.enter, enterdist);
+    float sides[4];
+    _mm_storeu_ps(sides, side);
+    int hit = group & ~_mm_movemask_ps(miss);
+    loopi(4) if(hit&(1<<i)) s.side[i] = int(sides[i]);
+    return hit;
+}
+#else
+static inline bool intersectshadowlane(const clipplanes &p, const vec &v, const vec &ray, const vec &invray, const ivec &lsizemask, int &side, float &enter)
+{
+    INTERSECTPLANES(side = p.side[i], return false);
+    INTERSECTBOX(side = (i<<1) + 1 - lsizemask[i], return false);
+    if(exitdist < 0) return false;
+    enter = enterdist;
+    return true;
+}
+
+static inline int intersectshadowpacket(const clipplanes &p, shadowpacket &s, int group)
+{
+    int hit = 0;
+    loopj(SHADOWRAYPACKET) if(group&(1<<j))
+    {
+        int side = s.side[j];
+        if(intersectshadowlane(p, vec(s.vx[j], s.vy[j], s.vz[j]), vec(s.rx[j], s.ry[j], s.rz[j]), vec(s.ix[j], s.iy[j], s.iz[j]), s.lsizemask[j], side, s.enter[j]))
+        {
+            s.side[j] = side;
+            hit |= 1<<j;
+        }
+    }
+    return hit;
+}
+#endif
+
+void shadowrays(ShadowRayCache *cache, const vec *o, const vec *ray, const float *radius, float *result, int mode, int lanes, extentity *t)
+{
+    shadowpacket s;
+    int active = 0;
+    loopi(SHADOWRAYPACKET) if(lanes&(1<<i))
+    {
+        if(!insideworld(o[i]) || ray[i].iszero() || !(lanes&~(1<<i)))
+        {
+            result[i] = shadowray(cache, o[i], ray[i], radius[i], mode, t);
+            continue;
+        }
+        shadowoccluderset *occluders = findshadowoccluders(cache, shadowanchor(o[i], ray[i], radius[i]), mode, t);
+        if(occluders)
+        {
+            float odist = testshadowoccluders(cache, occluders, o[i], ray[i], radius[i], mode);
+            if(odist < radius[i]) { result[i] = odist; continue; }
+        }
+        s.vx[i] = o[i].x; s.vy[i] = o[i].y; s.vz[i] = o[i].z;
+        s.rx[i] = ray[i].x; s.ry[i] = ray[i].y; s.rz[i] = ray[i].z;
+        s.ix[i] = ray[i].x ? 1/ray[i].x : 1e16f; s.iy[i] = ray[i].y ? 1/ray[i].y : 1e16f; s.iz[i] = ray[i].z ? 1/ray[i].z : 1e16f;
+        s.lsizemask[i] = ivec(s.ix[i]>0 ? 1 : 0, s.iy[i]>0 ? 1 : 0, s.iz[i]>0 ? 1 : 0);
+        s.pos[i] = ivec(int(o[i].x), int(o[i].y), int(o[i].z));
+        s.lastlo[i] = ivec(-1, -1, -1);
+        s.oclast[i] = NULL;
+        s.dist[i] = 0;
+        s.side[i] = O_BOTTOM;
+        active |= 1<<i;
+    }
+    if(!active) return;
+    loopi(SHADOWRAYPACKET) if(!(active&(1<<i))) { s.vx[i] = s.vy[i] = s.vz[i] = s.rx[i] = s.ry[i] = s.rz[i] = s.ix[i] = s.iy[i] = s.iz[i] = 0; s.side[i] = O_BOTTOM; }
+
+    cube *levels[20], *nodes[20];
+    levels[worldscale] = worldroot;
+    int lshift = worldscale;
+    ivec lo(0, 0, 0);
+    while(active)
+    {
+        // follow the first unfinished ray, then advance every ray that shares its leaf
+        int lead = 0;
+        while(!(active&(1<<lead))) lead++;
+        const ivec &lpos = s.pos[lead];
+        if(lshift < worldscale)
+        {
+            uint diff = (uint(lo.x^lpos.x)|uint(lo.y^lpos.y)|uint(lo.z^lpos.z))>>lshift;
+            while(diff) { lshift++; diff >>= 1; }
+        }
+        cube *lc = levels[lshift];
+        for(;;)
+        {
+            lshift--;
+            lc += octastep(lpos.x, lpos.y, lpos.z, lshift);
+            nodes[lshift] = lc;
+            if(lc->children==NULL) break;
+            lc = lc->children;
+            levels[lshift] = lc;
+        }
+        lo = ivec(lpos.x&(~0<<lshift), lpos.y&(~0<<lshift), lpos.z&(~0<<lshift));
+
+        int group = 0;
+        loopi(SHADOWRAYPACKET) if(active&(1<<i))
+        {
+            const ivec &p = s.pos[i];
+            if(((uint(p.x^lo.x)|uint(p.y^lo.y)|uint(p.z^lo.z))>>lshift) == 0) group |= 1<<i;
+        }
+
+        loopi(SHADOWRAYPACKET) if(group&(1<<i))
+        {
+            // only nodes this ray has not already passed through can hold new entities
+            int top = worldscale-1;
+            if(s.lastlo[i].x >= 0)
+            {
+                uint diff = uint(s.lastlo[i].x^lo.x)|uint(s.lastlo[i].y^lo.y)|uint(s.lastlo[i].z^lo.z);
+                for(top = -1; diff; diff >>= 1) top++;
+                top = min(top, worldscale-1);
+            }
+            s.lastlo[i] = lo;
+            for(int l = top; l >= lshift; l--)
+            {
+                cube &n = *nodes[l];
+                if(!n.ext || !n.ext->ents) continue;
+                extentity *hitent = NULL;
+                float edist = shadowent(n.ext->ents, s.oclast[i], o[i], ray[i], radius[i], mode, t, &hitent);
+                s.oclast[i] = n.ext->ents;
+                if(edist < 1e15f)
+                {
+                    addshadowent(cache, shadowanchor(o[i], ray[i], radius[i]), mode, t, hitent);
+                    result[i] = min(edist, s.dist[i]);
+                    group &= ~(1<<i);
+                    active &= ~(1<<i);
+                    break;
+                }
+            }
+        }
+
+        cube &c = *lc;
+        if(group && !isempty(c) && !(c.material&MAT_ALPHA))
+        {
+            int hit = group;
+            if(!isentirelysolid(c))
+            {
+                clipplanes &p = cache->clipcache[int(&c - worldroot)&(MAXCLIPPLANES-1)];
+                if(p.owner != &c || p.version != cache->version) { p.owner = &c; p.version = cache->version; genclipplanes(c, lo.x, lo.y, lo.z, 1<<lshift, p, false); }
+                hit = intersectshadowpacket(p, s, group);
+            }
+            loopi(SHADOWRAYPACKET) if(hit&(1<<i))
+            {
+                if(c.texture[s.side[i]]==DEFAULT_SKY && mode&RAY_SKIPSKY) result[i] = radius[i];
+                else
+                {
+                    result[i] = isentirelysolid(c) ? s.dist[i] : s.dist[i]+max(s.enter[i]+0.1f, 0.0f);
+                    addshadowoccluder(cache, shadowanchor(o[i], ray[i], radius[i]), mode, t, &c, NULL, lo, 1<<lshift);
+                }
+            }
+            group &= ~hit;
+            active &= ~hit;
+        }
+
+        loopi(SHADOWRAYPACKET) if(group&(1<<i))
+        {
+            const ivec &lsizemask = s.lsizemask[i];
+            float dx = (lo.x+(lsizemask.x<<lshift)-s.vx[i])*s.ix[i],
+                  dy = (lo.y+(lsizemask.y<<lshift)-s.vy[i])*s.iy[i],
+                  dz = (lo.z+(lsizemask.z<<lshift)-s.vz[i])*s.iz[i];
+            float disttonext = dx;
+            s.side[i] = O_RIGHT - lsizemask.x;
+            if(dy < disttonext) { disttonext = dy; s.side[i] = O_FRONT - lsizemask.y; }
+            if(dz < disttonext) { disttonext = dz; s.side[i] = O_TOP - lsizemask.z; }
+            disttonext += 0.1f;
+            s.vx[i] += s.rx[i]*disttonext;
+            s.vy[i] += s.ry[i]*disttonext;
+            s.vz[i] += s.rz[i]*disttonext;
+            s.dist[i] += disttonext;
+            if(s.dist[i] >= radius[i]) { result[i] = s.dist[i]; active &= ~(1<<i); continue; }
+            ivec &p = s.pos[i];
+            p = ivec(int(s.vx[i]), int(s.vy[i]), int(s.vz[i]));
+            uint diff = uint(lo.x^p.x)|uint(lo.y^p.y)|uint(lo.z^p.z);
+            if(diff >= uint(worldsize) || !(diff>>lshift)) { result[i] = radius[i]; active &= ~(1<<i); }
+        }
+    }
+}
+
 float rayent(const vec &o, const vec &ray, float radius, int mode, int size, int &orient, int &ent)
 {
     hitent = -1;
@@ -445,6 +840,75 @@ bool raycubelos(const vec &o, const vec &dest, vec &hitpos)
     return distance >= mag;
 }
 
+// batched line of sight queries: rays queued during a frame are traced together at the end of it,
+// ordered by origin cell so neighbouring rays reuse the octree path and clip plane cache
+
+struct losquery
+{
+    vec o, dest;
+    uint key;
+    int index;
+};
+
+struct losresult
+{
+    vec hitpos;
+    bool visible;
+};
+
+static vector<losquery> losqueries;
+static vector<losresult> losresults;
+static int losbatch = 0;
+
+static inline uint loskey(const vec &o)
+{
+    uint key = 0;
+    int x = clamp(int(o.x), 0, worldsize-1)>>4, y = clamp(int(o.y), 0, worldsize-1)>>4, z = clamp(int(o.z), 0, worldsize-1)>>4;
+    loopi(10) key |= (((x>>i)&1)<<(3*i)) | (((y>>i)&1)<<(3*i+1)) | (((z>>i)&1)<<(3*i+2));
+    return key;
+}
+
+static inline bool loscmp(const losquery &a, const losquery &b) { return a.key < b.key; }
+
+int queuelos(const vec &o, const vec &dest)
+{
+    if(losqueries.length() >= 0xFFFF) return -1;
+    losquery &q = losqueries.add();
+    q.o = o;
+    q.dest = dest;
+    q.key = loskey(o);
+    q.index = losqueries.length()-1;
+    return (((losbatch+1)&0x7FFF)<<16) | q.index;
+}
+
+int checklos(int id, vec &hitpos)
+{
+    if(id < 0 || (id>>16) != losbatch || !losresults.inrange(id&0xFFFF)) return -1;
+    const losresult &r = losresults[id&0xFFFF];
+    hitpos = r.hitpos;
+    return r.visible ? 1 : 0;
+}
+
+VAR(dbglos, 0, 0, 1);
+
+void flushlos()
+{
+    losresults.setsize(0);
+    losbatch = (losbatch+1)&0x7FFF;
+    if(losqueries.empty()) return;
+    losqueries.sort(loscmp);
+    losresults.reserve(losqueries.length());
+    losresults.advance(losqueries.length());
+    loopv(losqueries)
+    {
+        const losquery &q = losqueries[i];
+        losresult &r = losresults[q.index];
+        r.visible = raycubelos(q.o, q.dest, r.hitpos);
+    }
+    if(dbglos) conoutf(CON_DEBUG, "los: %d queries", losqueries.length());
+    losqueries.setsize(0);
+}
+
 float rayfloor(const vec &o, vec &floor, int mode, float radius)
 {
     if(o.z<=0) return -1;
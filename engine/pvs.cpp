@@ -259,6 +259,7 @@ struct pvsdata
 };
 
 static vector<uchar> pvsbuf;
+static int pvslivebytes = 0;
 
 static inline uint hthash(const pvsdata &k)
 {
@@ -285,7 +286,18 @@ struct viewcellrequest
 };
 static vector<viewcellrequest> viewcellrequests;
 
-static bool genpvs_canceled = false;
+struct pvsupdaterequest
+{
+    int *result;
+    ivec o;
+    int size;
+    vector<uchar> buf;
+};
+static vector<pvsupdaterequest> pvsupdates;
+static vector<int> pvsupdatesdone;
+static int pvsupdatenext = 0;
+
+static volatile bool genpvs_canceled = false;
 static int numviewcells = 0;
 
 VAR(maxpvsblocker, 1, 512, 1<<16);
@@ -299,8 +311,130 @@ static struct
     vector<materialsurface *> matsurfs;
 } waterplanes[MAXWATERPVS];
 static vector<materialsurface *> waterfalls;
+static vector<materialsurface> pvsmatsurfs;
 uint numwaterplanes = 0;
 
+// packed view cells: each node holds a leaf mask, a mask of fully occluded leaves and a mask of
+// partially occluded leaves, followed per child by its leaf value or a 1-2 byte offset to its node
+static inline int countbits(uint mask)
+{
+    int n = 0;
+    for(; mask; mask &= mask-1) n++;
+    return n;
+}
+
+#define MAXPVSDEPTH 32
+
+// src points at a serialized 9-byte node, whose child offsets must point forward and stay before end
+static bool packpvsnode(const uchar *src, const uchar *end, vector<uchar> &dst, int depth = 0)
+{
+    if(depth >= MAXPVSDEPTH || end - src < 9) return false;
+    uchar leafmask = src[0], fullmask = 0, partialmask = 0, widemask = 0;
+    vector<uchar> children[8];
+    loopi(8)
+    {
+        if(leafmask&(1<<i))
+        {
+            if(src[1+i]==0xFF) fullmask |= 1<<i;
+            else if(src[1+i]) partialmask |= 1<<i;
+        }
+        else if(!src[1+i] || 9*src[1+i] >= end - src || !packpvsnode(src + 9*src[1+i], end, children[i], depth+1)) return false;
+    }
+    int offsets[8];
+    for(;;)
+    {
+        int offset = 3 + countbits(partialmask) + countbits(uchar(~leafmask)) + countbits(widemask);
+        uchar wide = 0, overflow = 0;
+        loopi(8) if(!(leafmask&(1<<i)))
+        {
+            offsets[i] = offset;
+            if(offset > 0x7FFF) overflow |= 1<<i;
+            else if(offset >= 0x80) wide |= 1<<i;
+            offset += children[i].length();
+        }
+        // if offset won't fit, just mark the space as visible like serializepvs does
+        if(overflow) { leafmask |= overflow; widemask &= ~overflow; continue; }
+        if(!(wide&~widemask)) break;
+        widemask |= wide;
+    }
+    dst.add(leafmask);
+    dst.add(fullmask);
+    dst.add(partialmask);
+    loopi(8)
+    {
+        if(leafmask&(1<<i)) { if(partialmask&(1<<i)) dst.add(src[1+i]); }
+        else if(widemask&(1<<i)) { dst.add(0x80 | (offsets[i]>>8)); dst.add(offsets[i]&0xFF); }
+        else dst.add(offsets[i]);
+    }
+    loopi(8) if(!(leafmask&(1<<i))) dst.put(children[i].getbuf(), children[i].length());
+    return true;
+}
+
+static bool packpvs(int wateroccluded, int waterbytes, const uchar *buf, int len, vector<uchar> &dst)
+{
+    int start = dst.length();
+    dst.add(waterbytes);
+    loopi(waterbytes) dst.add((wateroccluded>>(i*8))&0xFF);
+    if(packpvsnode(buf, buf + len, dst)) return true;
+    dst.setsize(start);
+    return false;
+}
+
+// returns the leaf value of child i, or the node of child i if it is not a leaf
+static inline const uchar *pvschild(const uchar *buf, int i)
+{
+    uchar leafmask = buf[0], partialmask = buf[2];
+    const uchar *p = buf + 3;
+    loopj(i)
+    {
+        if(!(leafmask&(1<<j))) p += *p&0x80 ? 2 : 1;
+        else if(partialmask&(1<<j)) p++;
+    }
+    if(leafmask&(1<<i)) return p;
+    return buf + (*p&0x80 ? ((p[0]&0x7F)<<8) | p[1] : p[0]);
+}
+
+static inline uchar pvsleafvalue(const uchar *buf, int i)
+{
+    if(buf[1]&(1<<i)) return 0xFF;
+    if(!(buf[2]&(1<<i))) return 0;
+    return *pvschild(buf, i);
+}
+
+static inline uchar *pvstree(const pvsdata &d, int *waterpvs = NULL)
+{
+    uchar *buf = &pvsbuf[d.offset];
+    int waterbytes = *buf++;
+    if(waterpvs)
+    {
+        *waterpvs = 0;
+        loopi(waterbytes) *waterpvs |= buf[i] << (i*8);
+    }
+    return buf + waterbytes;
+}
+
+static int rawpvssize(const uchar *buf)
+{
+    int size = 9;
+    loopi(8) if(!(buf[0]&(1<<i))) size += rawpvssize(pvschild(buf, i));
+    return size;
+}
+
+static int addviewcellpvs(const uchar *buf, int len)
+{
+    pvsdata key(pvsbuf.length(), len);
+    pvsbuf.put(buf, len);
+    int *val = pvscompress.access(key);
+    if(val) pvsbuf.setsize(key.offset);
+    else
+    {
+        val = &pvscompress[key];
+        *val = pvs.length();
+        pvs.add(key);
+    }
+    return *val;
+}
+
 struct pvsworker
 {
     pvsworker() : thread(NULL), pvsnodes(new pvsnode[origpvsnodes.length()])
@@ -676,7 +810,7 @@ struct pvsworker
         return false;
     }
     
-    vector<uchar> outbuf;
+    vector<uchar> outbuf, packbuf;
 
     bool serializepvs(pvsnode &p, int storage = -1)
     {
@@ -781,10 +915,12 @@ struct pvsworker
     {
         calcpvs(co, size);
 
-        uchar *buf = new uchar[outbuf.length()];
-        memcpy(buf, outbuf.getbuf(), outbuf.length());
+        packbuf.setsize(0);
+        packpvsnode(outbuf.getbuf(), outbuf.getbuf() + outbuf.length(), packbuf);
+        uchar *buf = new uchar[packbuf.length()];
+        memcpy(buf, packbuf.getbuf(), packbuf.length());
         if(waterpvs) *waterpvs = wateroccluded;
-        if(len) *len = outbuf.length();
+        if(len) *len = packbuf.length();
         return buf;
     }
 
@@ -792,21 +928,14 @@ struct pvsworker
     {
         calcpvs(co, size);
 
+        packbuf.setsize(0);
+        packpvs(wateroccluded, waterbytes, outbuf.getbuf(), outbuf.length(), packbuf);
+
         if(pvsmutex) SDL_LockMutex(pvsmutex);
         numviewcells++;
-        pvsdata key(pvsbuf.length(), waterbytes + outbuf.length());
-        loopi(waterbytes) pvsbuf.add((wateroccluded>>(i*8))&0xFF);
-        pvsbuf.put(outbuf.getbuf(), outbuf.length());
-        int *val = pvscompress.access(key);
-        if(val) pvsbuf.setsize(key.offset);
-        else
-        {
-            val = &pvscompress[key];
-            *val = pvs.length();
-            pvs.add(key);
-        }
+        int val = addviewcellpvs(packbuf.getbuf(), packbuf.length());
         if(pvsmutex) SDL_UnlockMutex(pvsmutex);
-        return *val;
+        return val;
     }
 
     static int run(void *data)
@@ -824,6 +953,25 @@ struct pvsworker
         SDL_UnlockMutex(viewcellmutex);
         return 0;
     }
+
+    // background update: results are merged into pvsbuf on the main thread
+    static int update(void *data)
+    {
+        pvsworker *w = (pvsworker *)data;
+        SDL_LockMutex(viewcellmutex);
+        while(!genpvs_canceled && pvsupdatenext < pvsupdates.length())
+        {
+            int index = pvsupdatenext++;
+            pvsupdaterequest &req = pvsupdates[index];
+            SDL_UnlockMutex(viewcellmutex);
+            w->calcpvs(req.o, req.size);
+            packpvs(w->wateroccluded, w->waterbytes, w->outbuf.getbuf(), w->outbuf.length(), req.buf);
+            SDL_LockMutex(viewcellmutex);
+            if(!genpvs_canceled) pvsupdatesdone.add(index);
+        }
+        SDL_UnlockMutex(viewcellmutex);
+        return 0;
+    }
 };
 
 struct viewcellnode
@@ -987,11 +1135,10 @@ static void lockpvs_(bool lock)
     if(!lock) return;
     pvsdata *d = lookupviewcell(camera1->o);
     if(!d) return;
-    int wbytes = d->len%9, len = d->len - wbytes;
+    uchar *buf = pvstree(*d, &lockedwaterpvs);
+    int len = d->len - (buf - &pvsbuf[d->offset]);
     lockedpvs = new uchar[len];
-    memcpy(lockedpvs, &pvsbuf[d->offset + wbytes], len);
-    lockedwaterpvs = 0;
-    loopi(wbytes) lockedwaterpvs |= pvsbuf[d->offset + i] << (i*8);
+    memcpy(lockedpvs, buf, len);
     loopi(MAXWATERPVS) lockedwaterplanes[i] = waterplanes[i].height;
     conoutf("locked view cell at %.1f, %.1f, %.1f", camera1->o.x, camera1->o.y, camera1->o.z);
 }
@@ -1001,8 +1148,11 @@ VARF(lockpvs, 0, 0, 1, lockpvs_(lockpvs!=0));
 VARN(pvs, usepvs, 0, 1, 1);
 VARN(waterpvs, usewaterpvs, 0, 1, 1);
 
+static void checkpvsupdate();
+
 void setviewcell(const vec &p)
 {
+    checkpvsupdate();
     if(!usepvs) curpvs = NULL;
     else if(lockedpvs) 
     {
@@ -1012,21 +1162,22 @@ void setviewcell(const vec &p)
     else
     {
         pvsdata *d = lookupviewcell(p);
-        curpvs = d ? &pvsbuf[d->offset] : NULL;
-        curwaterpvs = 0;
-        if(d)
-        {
-            loopi(d->len%9) curwaterpvs |= *curpvs++ << (i*8);
-        }
+        curpvs = d ? pvstree(*d, &curwaterpvs) : NULL;
+        if(!d) curwaterpvs = 0;
     }
     if(!usepvs || !usewaterpvs) curwaterpvs = 0;
 }
 
+static void cancelpvsupdate(bool discard = false);
+
 void clearpvs()
 {
+    cancelpvsupdate(true);
     DELETEP(viewcells);
+    pvscompress.clear();
     pvs.setsize(0);
     pvsbuf.setsize(0);
+    pvslivebytes = 0;
     curpvs = NULL;
     numwaterplanes = 0;
     lockpvs = 0;
@@ -1035,16 +1186,21 @@ void clearpvs()
 
 COMMAND(clearpvs, "");
 
-static void findwaterplanes()
+// surfaces are copied so background updates never see a rebuilt matbuf
+// keep preserves existing plane indices that stored view cells refer to
+static void findwaterplanes(bool keep = false)
 {
     extern vector<vtxarray *> valist;
+    if(!keep) numwaterplanes = 0;
+    bool haswaterfalls = false;
     loopi(MAXWATERPVS)
     {
-        waterplanes[i].height = -1;
+        if(i >= int(numwaterplanes)) waterplanes[i].height = -1;
+        else if(waterplanes[i].height < 0) haswaterfalls = true;
         waterplanes[i].matsurfs.setsize(0);
     }
     waterfalls.setsize(0);
-    numwaterplanes = 0;
+    pvsmatsurfs.setsize(0);
     loopv(valist)
     {
         vtxarray *va = valist[i];
@@ -1052,30 +1208,36 @@ static void findwaterplanes()
         {
             materialsurface &m = va->matbuf[j];
             if((m.material&MATF_VOLUME)!=MAT_WATER || m.orient==O_BOTTOM) { j += m.skip; continue; }
-            if(m.orient!=O_TOP)
-            {
-                waterfalls.add(&m);
-                continue;
-            }
-            loopk(numwaterplanes) if(waterplanes[k].height == m.o.z)
-            {
-                waterplanes[k].matsurfs.add(&m);
-                goto nextmatsurf;
-            }
-            if(numwaterplanes < MAXWATERPVS)
-            {
-                waterplanes[numwaterplanes].height = m.o.z;
-                waterplanes[numwaterplanes].matsurfs.add(&m);
-                numwaterplanes++;
-            }
-        nextmatsurf:;
+            pvsmatsurfs.add(m);
         }
     }
-    if(waterfalls.length() > 0 && numwaterplanes < MAXWATERPVS) numwaterplanes++;
+    loopv(pvsmatsurfs)
+    {
+        materialsurface &m = pvsmatsurfs[i];
+        if(m.orient!=O_TOP)
+        {
+            waterfalls.add(&m);
+            continue;
+        }
+        loopk(numwaterplanes) if(waterplanes[k].height == m.o.z)
+        {
+            waterplanes[k].matsurfs.add(&m);
+            goto nextmatsurf;
+        }
+        if(numwaterplanes < MAXWATERPVS)
+        {
+            waterplanes[numwaterplanes].height = m.o.z;
+            waterplanes[numwaterplanes].matsurfs.add(&m);
+            numwaterplanes++;
+        }
+    nextmatsurf:;
+    }
+    if(waterfalls.length() > 0 && !haswaterfalls && numwaterplanes < MAXWATERPVS) numwaterplanes++;
 }
 
 void testpvs(int *vcsize)
 {
+    cancelpvsupdate();
     lockpvs_(false);
 
     uint oldnumwaterplanes = numwaterplanes;
@@ -1181,7 +1343,6 @@ void genpvs(int *viewcellsize)
     pvsworkers.deletecontents();
 
     origpvsnodes.setsize(0);
-    pvscompress.clear();
 
     Uint32 end = SDL_GetTicks();
     if(genpvs_canceled) 
@@ -1197,13 +1358,21 @@ COMMAND(genpvs, "i");
 
 void pvsstats()
 {
+    int rawlen = 0;
+    loopv(pvs)
+    {
+        int waterbytes = pvsbuf[pvs[i].offset];
+        rawlen += waterbytes + rawpvssize(pvstree(pvs[i]));
+    }
     conoutf("%d unique view cells totaling %.1f kB and averaging %d B",          
         pvs.length(), pvsbuf.length()/1024.0f, pvsbuf.length()/max(pvs.length(), 1));
+    conoutf("packed %.1f kB of %.1f kB unpacked (%d%%)",
+        pvsbuf.length()/1024.0f, rawlen/1024.0f, rawlen ? int(100.0f*pvsbuf.length()/rawlen) : 100);
 }
 
 COMMAND(pvsstats, "");
 
-static inline bool pvsoccluded(uchar *buf, const ivec &co, int size, const ivec &bborigin, const ivec &bbsize)
+static inline bool pvsoccluded(const uchar *buf, const ivec &co, int size, const ivec &bborigin, const ivec &bbsize)
 {
     uchar leafmask = buf[0];
     loopoctabox(co, size, bborigin, bbsize)
@@ -1211,16 +1380,16 @@ static inline bool pvsoccluded(uchar *buf, const ivec &co, int size, const ivec
         ivec o(i, co.x, co.y, co.z, size);
         if(leafmask&(1<<i))
         {
-            uchar leafvalues = buf[1+i];
+            uchar leafvalues = pvsleafvalue(buf, i);
             if(!leafvalues || (leafvalues!=0xFF && octantrectangleoverlap(o, size>>1, bborigin, bbsize)&~leafvalues))
                 return false;
         }
-        else if(!pvsoccluded(buf+9*buf[1+i], o, size>>1, bborigin, bbsize)) return false;
+        else if(!pvsoccluded(pvschild(buf, i), o, size>>1, bborigin, bbsize)) return false;
     }
     return true;
 }
 
-static inline bool pvsoccluded(uchar *buf, const ivec &bborigin, const ivec &bbsize)
+static inline bool pvsoccluded(const uchar *buf, const ivec &bborigin, const ivec &bbsize)
 {
     int diff = (bborigin.x^(bborigin.x+bbsize.x)) | (bborigin.y^(bborigin.y+bbsize.y)) | (bborigin.z^(bborigin.z+bbsize.z));
     if(diff&~((1<<worldscale)-1)) return false;
@@ -1232,10 +1401,10 @@ static inline bool pvsoccluded(uchar *buf, const ivec &bborigin, const ivec &bbs
         uchar leafmask = buf[0];
         if(leafmask&(1<<i))
         {
-            uchar leafvalues = buf[1+i];
+            uchar leafvalues = pvsleafvalue(buf, i);
             return leafvalues && (leafvalues==0xFF || !(octantrectangleoverlap(ivec(bborigin).mask(~((2<<scale)-1)), 1<<scale, bborigin, bbsize)&~leafvalues));
         }
-        buf += 9*buf[1+i];
+        buf = pvschild(buf, i);
     }
     return pvsoccluded(buf, ivec(bborigin).mask(~((2<<scale)-1)), 1<<scale, bborigin, bbsize);
 }
@@ -1245,6 +1414,208 @@ bool pvsoccluded(const ivec &bborigin, const ivec &bbsize)
     return curpvs!=NULL && pvsoccluded(curpvs, bborigin, bbsize);
 }
 
+VAR(autoupdatepvs, 0, 1, 1);
+VAR(pvsupdatedelay, 0, 1000, 60000);
+VAR(dbgpvsupdate, 0, 0, 1);
+
+static vector<viewcellrequest> pvsupdatequeue;
+static vector<pvsworker *> pvsupdateworkers;
+static int pvsupdatemillis = 0, pvsupdatestart = 0, pvsupdatesmerged = 0;
+
+static void compactviewcellpvs(viewcellnode &p, vector<int> &remap, vector<pvsdata> &livepvs, vector<uchar> &livebuf)
+{
+    loopi(8)
+    {
+        if(!(p.leafmask&(1<<i))) { compactviewcellpvs(*p.children[i].node, remap, livepvs, livebuf); continue; }
+        int &vc = p.children[i].pvs;
+        if(!pvs.inrange(vc)) continue;
+        if(remap[vc] < 0)
+        {
+            remap[vc] = livepvs.length();
+            livepvs.add(pvsdata(livebuf.length(), pvs[vc].len));
+            livebuf.put(&pvsbuf[pvs[vc].offset], pvs[vc].len);
+        }
+        vc = remap[vc];
+    }
+}
+
+// incremental updates leave superseded view cells behind in pvsbuf, so drop any no view cell refers to anymore
+static void compactpvs()
+{
+    if(!viewcells) return;
+    vector<int> remap;
+    loopv(pvs) remap.add(-1);
+    vector<pvsdata> livepvs;
+    vector<uchar> livebuf;
+    compactviewcellpvs(*viewcells, remap, livepvs, livebuf);
+    pvs.setsize(0);
+    pvs.move(livepvs);
+    pvsbuf.setsize(0);
+    pvsbuf.move(livebuf);
+    pvscompress.clear();
+    loopv(pvs) pvscompress[pvs[i]] = i;
+    pvslivebytes = pvsbuf.length();
+}
+
+// a view cell only needs recomputing if it contains the changed block or can currently see it,
+// since any shaft into a block the cell already finds occluded is blocked before reaching it
+static void queuepvsupdates(viewcellnode &p, const ivec &co, int size, const ivec &bborigin, const ivec &bbsize)
+{
+    loopi(8)
+    {
+        ivec o(i, co.x, co.y, co.z, size);
+        if(!(p.leafmask&(1<<i)))
+        {
+            queuepvsupdates(*p.children[i].node, o, size>>1, bborigin, bbsize);
+            continue;
+        }
+        int &vc = p.children[i].pvs;
+        bool inside = o.x < bborigin.x+bbsize.x && o.y < bborigin.y+bbsize.y && o.z < bborigin.z+bbsize.z &&
+                      o.x+size > bborigin.x && o.y+size > bborigin.y && o.z+size > bborigin.z;
+        if(!inside && (vc < 0 || pvsoccluded(pvstree(pvs[vc]), bborigin, bbsize))) continue;
+        vc = -1;
+        viewcellrequest &req = pvsupdatequeue.add();
+        req.result = &vc;
+        req.o = o;
+        req.size = size;
+    }
+}
+
+static void mergepvsupdates()
+{
+    if(pvscompress.numelems != pvs.length())
+    {
+        pvscompress.clear();
+        loopv(pvs) pvscompress[pvs[i]] = i;
+    }
+    SDL_LockMutex(viewcellmutex);
+    loopv(pvsupdatesdone)
+    {
+        pvsupdaterequest &req = pvsupdates[pvsupdatesdone[i]];
+        *req.result = addviewcellpvs(req.buf.getbuf(), req.buf.length());
+        req.result = NULL;
+        pvsupdatesmerged++;
+    }
+    pvsupdatesdone.setsize(0);
+    SDL_UnlockMutex(viewcellmutex);
+    if(pvsbuf.length() > 2*pvslivebytes + (1<<16)) compactpvs();
+}
+
+static void stoppvsupdate()
+{
+    genpvs_canceled = true;
+    loopv(pvsupdateworkers) SDL_WaitThread(pvsupdateworkers[i]->thread, NULL);
+    pvsupdateworkers.deletecontents();
+    genpvs_canceled = false;
+}
+
+static void cancelpvsupdate(bool discard)
+{
+    if(pvsupdateworkers.length())
+    {
+        stoppvsupdate();
+        if(!discard)
+        {
+            mergepvsupdates();
+            loopv(pvsupdates) if(pvsupdates[i].result)
+            {
+                viewcellrequest &req = pvsupdatequeue.add();
+                req.result = pvsupdates[i].result;
+                req.o = pvsupdates[i].o;
+                req.size = pvsupdates[i].size;
+            }
+        }
+        pvsupdates.shrink(0);
+        pvsupdatesdone.setsize(0);
+        origpvsnodes.setsize(0);
+    }
+    if(discard) pvsupdatequeue.setsize(0);
+}
+
+static inline bool viewcellrequestcmp(const viewcellrequest &x, const viewcellrequest &y)
+{
+    return x.result < y.result;
+}
+
+static bool isviewcellsolid(const ivec &o, int size)
+{
+    ivec ro;
+    int rsize;
+    cube &c = lookupcube(o.x, o.y, o.z, size, ro, rsize);
+    if(c.children) return isallclip(c.children);
+    return isentirelysolid(c) || (c.material&MATF_CLIP)==MAT_CLIP;
+}
+
+static void startpvsupdate()
+{
+    calcpvsbounds();
+    findwaterplanes(true);
+
+    pvsupdatequeue.sort(viewcellrequestcmp);
+    loopv(pvsupdatequeue)
+    {
+        viewcellrequest &r = pvsupdatequeue[i];
+        if(i && r.result == pvsupdatequeue[i-1].result) continue;
+        if(pvsbounds.outside(r.o, r.size) || isviewcellsolid(r.o, r.size)) continue;
+        pvsupdaterequest &req = pvsupdates.add();
+        req.result = r.result;
+        req.o = r.o;
+        req.size = r.size;
+    }
+    pvsupdatequeue.setsize(0);
+    if(pvsupdates.empty()) return;
+
+    pvsnode &root = origpvsnodes.add();
+    memset(root.edges.v, 0xFF, 3);
+    root.flags = 0;
+    root.children = 0;
+    genpvsnodes(worldroot);
+
+    pvsupdatenext = 0;
+    pvsupdatesmerged = 0;
+    pvsupdatestart = SDL_GetTicks();
+    genpvs_canceled = false;
+    if(!viewcellmutex) viewcellmutex = SDL_CreateMutex();
+    int numthreads = max((pvsthreads > 0 ? pvsthreads : numcpus) - 1, 1);
+    loopi(min(numthreads, pvsupdates.length()))
+    {
+        pvsworker *w = pvsupdateworkers.add(new pvsworker);
+        w->thread = SDL_CreateThread(pvsworker::update, w);
+    }
+}
+
+static void checkpvsupdate()
+{
+    if(pvsupdateworkers.length())
+    {
+        mergepvsupdates();
+        if(pvsupdatesmerged < pvsupdates.length()) return;
+        stoppvsupdate();
+        compactpvs();
+        if(dbgpvsupdate) conoutf(CON_DEBUG, "updated %d view cells (%d unique, %.1f seconds)", pvsupdates.length(), pvs.length(), (SDL_GetTicks() - pvsupdatestart) / 1000.0f);
+        pvsupdates.shrink(0);
+        origpvsnodes.setsize(0);
+    }
+    else if(autoupdatepvs && pvsupdatequeue.length() && totalmillis - pvsupdatemillis >= pvsupdatedelay) startpvsupdate();
+}
+
+void pvschanged(const ivec &bborigin, const ivec &bbsize)
+{
+    if(!viewcells) return;
+    cancelpvsupdate();
+    queuepvsupdates(*viewcells, ivec(0, 0, 0), worldsize>>1, bborigin, bbsize);
+    pvsupdatemillis = totalmillis;
+}
+
+void updatepvs()
+{
+    if(!viewcells || pvsupdateworkers.length()) return;
+    if(pvsupdatequeue.empty()) conoutf("no view cells need updating");
+    else startpvsupdate();
+}
+
+COMMAND(updatepvs, "");
+
 bool waterpvsoccluded(int height)
 {
     if(!curwaterpvs) return false;
@@ -1269,9 +1640,37 @@ void saveviewcells(stream *f, viewcellnode &p)
     }
 }
 
+// rebuilds the serialized 9-byte nodes of a packed cell, laid out as serializepvs does
+static void unpackpvsnode(const uchar *buf, vector<uchar> &dst)
+{
+    int index = dst.length();
+    uchar leafmask = buf[0];
+    dst.add(leafmask);
+    loopi(8) dst.add(leafmask&(1<<i) ? pvsleafvalue(buf, i) : 0);
+    loopi(8) if(!(leafmask&(1<<i)))
+    {
+        // if offset won't fit, just mark the space as visible like serializepvs does
+        int offset = (dst.length() - index)/9;
+        if(offset > 255) { dst[index] |= 1<<i; continue; }
+        dst[index+1+i] = uchar(offset);
+        unpackpvsnode(pvschild(buf, i), dst);
+    }
+}
+
+// maps keep the serialized layout, with the water bytes given by len%9, and are packed again on load
 void savepvs(stream *f)
 {
-    uint totallen = pvsbuf.length() | (numwaterplanes>0 ? 0x80000000U : 0);
+    vector<uchar> rawbuf;
+    vector<ushort> rawlens;
+    loopv(pvs)
+    {
+        int start = rawbuf.length(), wateroccluded = 0;
+        const uchar *tree = pvstree(pvs[i], &wateroccluded);
+        loopj(pvsbuf[pvs[i].offset]) rawbuf.add((wateroccluded>>(j*8))&0xFF);
+        unpackpvsnode(tree, rawbuf);
+        rawlens.add(rawbuf.length() - start);
+    }
+    uint totallen = rawbuf.length() | (numwaterplanes>0 ? 0x80000000U : 0);
     f->putlil<uint>(totallen);
     if(numwaterplanes>0)
     {
@@ -1282,8 +1681,8 @@ void savepvs(stream *f)
             if(waterplanes[i].height < 0) break;
         }
     }
-    loopv(pvs) f->putlil<ushort>(pvs[i].len);
-    f->write(pvsbuf.getbuf(), pvsbuf.length());
+    loopv(rawlens) f->putlil<ushort>(rawlens[i]);
+    f->write(rawbuf.getbuf(), rawbuf.length());
     saveviewcells(f, *viewcells);
 }
 
@@ -1315,9 +1714,32 @@ void loadpvs(stream *f, int numpvs)
         pvs.add(pvsdata(offset, len));
         offset += len;
     }
-    f->read(pvsbuf.reserve(totallen).buf, totallen);
-    pvsbuf.advance(totallen);
+    bool valid = offset <= int(totallen) && f->read(pvsbuf.reserve(totallen).buf, totallen) == int(totallen);
+    if(valid) pvsbuf.advance(totallen);
+    if(valid)
+    {
+        vector<uchar> rawbuf;
+        rawbuf.move(pvsbuf);
+        loopv(pvs)
+        {
+            pvsdata &d = pvs[i];
+            int waterbytes = d.len%9, wateroccluded = 0;
+            if(waterbytes > 4) { valid = false; break; }
+            loopj(waterbytes) wateroccluded |= rawbuf[d.offset + j] << (j*8);
+            int packedoffset = pvsbuf.length();
+            if(!packpvs(wateroccluded, waterbytes, &rawbuf[d.offset + waterbytes], d.len - waterbytes, pvsbuf)) { valid = false; break; }
+            d = pvsdata(packedoffset, pvsbuf.length() - packedoffset);
+        }
+    }
     viewcells = loadviewcells(f);
+    if(!valid)
+    {
+        conoutf(CON_WARN, "invalid pvs data, discarding pvs");
+        DELETEP(viewcells);
+        pvs.setsize(0);
+        pvsbuf.setsize(0);
+        numwaterplanes = 0;
+    }
 }
 
 int getnumviewcells() { return pvs.length(); }
@@ -5,6 +5,102 @@ VARP(animationinterpolationtime, 0, 150, 1000);
 
 model *loadingmodel = NULL;
 
+// processed model data is kept under cache/model, keyed by the source file's path, size and mtime plus a
+// crc of whatever loader state got baked into it, and is read back with a single loadfile
+
+#define MODELCACHEMAGIC 0x314C444D // "MDL1" in native byte order
+#define MODELCACHEVERSION 1 // bump whenever the layout of a cached mesh, anim or BIH changes
+
+VARP(modelcache, 0, 1, 1);
+
+struct modelcacheheader
+{
+    uint magic, version, keylen;
+};
+
+bool modelcachekey(const char *kind, const char *name, const char *file, uint salt, string &key)
+{
+    if(!modelcache) return false;
+    size_t size = 0;
+    uint mtime = 0;
+    if(file && !getfileinfo(findfile(file, "rb"), size, mtime)) return false;
+    formatstring(key)("%s|%s|%u|%u|%08x", kind, name, uint(size), mtime, salt);
+    return true;
+}
+
+static const char *modelcachefile(const char *key)
+{
+    static string name;
+    formatstring(name)("cache/model/%08x.mdc", uint(crc32(0, (const Bytef *)key, strlen(key))));
+    return name;
+}
+
+uchar *loadmodelcache(const char *key, ucharbuf &p)
+{
+    int len = 0;
+    uchar *buf = (uchar *)loadfile(path(modelcachefile(key), true), &len, false);
+    if(!buf) return NULL;
+    modelcacheheader hdr;
+    uint keylen = strlen(key);
+    if(len < int(sizeof(hdr))) { delete[] buf; return NULL; }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if(hdr.magic != MODELCACHEMAGIC || hdr.version != MODELCACHEVERSION || hdr.keylen != keylen || len < int(sizeof(hdr) + keylen) || memcmp(&buf[sizeof(hdr)], key, keylen))
+    {
+        delete[] buf;
+        return NULL;
+    }
+    p = ucharbuf(&buf[sizeof(hdr) + keylen], len - int(sizeof(hdr) + keylen));
+    return buf;
+}
+
+stream *savemodelcache(const char *key)
+{
+    if(!createcachedir("model")) return NULL;
+    stream *f = openrawfile(path(modelcachefile(key), true), "wb");
+    if(!f) return NULL;
+    modelcacheheader hdr = { MODELCACHEMAGIC, MODELCACHEVERSION, uint(strlen(key)) };
+    f->write(&hdr, sizeof(hdr));
+    f->write(key, hdr.keylen);
+    return f;
+}
+
+template<class T> static inline void putmodelcache(stream *f, const T &val)
+{
+    f->write(&val, sizeof(T));
+}
+
+static void putmodelcachestring(stream *f, const char *s)
+{
+    int len = s ? strlen(s) : -1;
+    f->write(&len, sizeof(len));
+    if(len > 0) f->write(s, len);
+}
+
+static char *getmodelcachestring(ucharbuf &p)
+{
+    int len = -1;
+    p.get((uchar *)&len, sizeof(len));
+    if(len < 0) return NULL;
+    if(len > p.remaining()) { p.forceoverread(); return NULL; }
+    return newstring((const char *)p.subbuf(len).buf, len);
+}
+
+template<class T> static T *getmodelcachearray(ucharbuf &p, int n)
+{
+    if(n <= 0) return NULL;
+    if(n > p.remaining()/int(sizeof(T))) { p.forceoverread(); return NULL; }
+    T *a = new T[n];
+    p.get((uchar *)a, n*sizeof(T));
+    return a;
+}
+
+template<class T> static inline T getmodelcache(ucharbuf &p)
+{
+    T val = T(0);
+    p.get((uchar *)&val, sizeof(T));
+    return val;
+}
+
 #include "ragdoll.h"
 #include "animmodel.h"
 #include "vertmodel.h"
@@ -39,6 +135,32 @@ MODELTYPE(MDL_OBJ, obj);
 MODELTYPE(MDL_SMD, smd);
 MODELTYPE(MDL_IQM, iqm);
 
+// times CPU skinning of the given skeletal models at numinstances poses each, with and without the SIMD kernels
+void skelsimdbench(char *names, int *instances)
+{
+#ifndef SKELSSE
+    conoutf(CON_ERROR, "skeletal SIMD kernels are not available in this build");
+#else
+    vector<char *> models;
+    explodelist(names, models);
+    int numinstances = *instances > 0 ? *instances : 64, benched = 0, mismatches = 0;
+    uint millis[2][2] = { { 0, 0 }, { 0, 0 } };
+    loopv(models)
+    {
+        model *m = loadmodel(models[i]);
+        if(!m || !m->skeletal()) { conoutf(CON_ERROR, "could not load skeletal model: %s", models[i]); continue; }
+        ((skelmodel *)m)->benchskin(numinstances, millis, mismatches);
+        benched++;
+    }
+    models.deletearrays();
+    if(!benched) return;
+    static const char * const skinning[2] = { "dual quaternion", "matrix" };
+    loopi(2) conoutf("%s: %d models x %d instances, scalar %u ms, simd %u ms (%.2fx)", skinning[i], benched, numinstances, millis[i][0], millis[i][1], millis[i][0]/float(max(millis[i][1], 1U)));
+    if(mismatches) conoutf(CON_ERROR, "%d skinned vertices differ between scalar and SIMD", mismatches);
+#endif
+}
+COMMAND(skelsimdbench, "si");
+
 #define checkmdl if(!loadingmodel) { conoutf(CON_ERROR, "not loading a model"); return; }
 
 void mdlcullface(int *cullface)
@@ -378,6 +500,78 @@ void flushpreloadedmodels(bool msg)
     loadprogress = 0;
 }
 
+// models themselves load serially since their configs run script and create textures and buffers, but the BIHs
+// of distinct models only touch their own triangles and so are built on worker threads
+
+VARP(modelthreads, 0, 0, 16);
+
+struct bihbuild
+{
+    BIH *bih;
+    bool cached;
+    string cachekey;
+};
+
+static SDL_mutex *bihbuildmutex = NULL;
+static vector<bihbuild> bihbuilds;
+static int bihbuildnext = 0;
+
+static int bihbuildthread(void *data)
+{
+    for(;;)
+    {
+        SDL_LockMutex(bihbuildmutex);
+        int i = bihbuildnext < bihbuilds.length() ? bihbuildnext++ : -1;
+        SDL_UnlockMutex(bihbuildmutex);
+        if(i < 0) break;
+        BIH *bih = bihbuilds[i].bih;
+        bih->gennodes();
+        bih->finishnodes();
+    }
+    return 0;
+}
+
+static void preloadBIHs(vector<model *> &models)
+{
+    if(!bihbuildmutex) bihbuildmutex = SDL_CreateMutex();
+    loopv(models)
+    {
+        model *m = models[i];
+        if(m->bih) continue;
+        if(!bihbuildmutex) continue;
+        BIH *bih = m->newBIH();
+        if(!bih) continue;
+        m->bih = bih;
+        if(!bih->numtris) continue;
+        bihbuild &b = bihbuilds.add();
+        b.bih = bih;
+        b.cached = bih->cachekey(m->name(), b.cachekey);
+        if(b.cached && bih->loadnodes(b.cachekey))
+        {
+            bih->finishnodes();
+            bihbuilds.drop();
+        }
+    }
+    if(bihbuilds.length())
+    {
+        bihbuildnext = 0;
+        vector<SDL_Thread *> threads;
+        int numthreads = min(modelthreads > 0 ? modelthreads : numcpus, bihbuilds.length());
+        loopi(numthreads-1)
+        {
+            SDL_Thread *thread = SDL_CreateThread(bihbuildthread, NULL);
+            if(thread) threads.add(thread);
+        }
+        bihbuildthread(NULL);
+        loopv(threads) SDL_WaitThread(threads[i], NULL);
+
+        loopv(bihbuilds) if(bihbuilds[i].cached) bihbuilds[i].bih->savenodes(bihbuilds[i].cachekey);
+        bihbuilds.setsize(0);
+    }
+    // alpha masks of the skins are loaded here on the main thread, as calclight workers can't load them
+    loopv(models) models[i]->preloadBIH();
+}
+
 void preloadusedmapmodels(bool msg, bool bih)
 {
     vector<extentity *> &ents = entities::getents();
@@ -388,6 +582,7 @@ void preloadusedmapmodels(bool msg, bool bih)
         if(e.type==ET_MAPMODEL && e.attr2 >= 0 && mapmodels.find(e.attr2) < 0) mapmodels.add(e.attr2);
     }
 
+    vector<model *> bihmodels;
     loopv(mapmodels)
     {
         loadprogress = float(i+1)/mapmodels.length();
@@ -397,11 +592,13 @@ void preloadusedmapmodels(bool msg, bool bih)
         else if(mmi->name[0] && !loadmodel(NULL, mmindex, msg)) { if(msg) conoutf(CON_WARN, "could not load model: %s", mmi->name); }
         else if(mmi->m)
         {
-            if(bih) mmi->m->preloadBIH();
+            if(bih && bihmodels.find(mmi->m) < 0) bihmodels.add(mmi->m);
             mmi->m->preloadmeshes();
         }
     }
     loadprogress = 0;
+
+    if(bihmodels.length()) preloadBIHs(bihmodels);
 }
 
 model *loadmodel(const char *name, int i, bool msg)
@@ -3,6 +3,81 @@ VARP(matskel, 0, 1, 1);
 
 VAR(maxskelanimdata, 1, 192, 0);
 
+// SSE kernels for the CPU skinning path, used when bones don't fit in GPU uniforms or gpuskel is off;
+// they perform the same operations in the same order as the scalar code so the results match exactly
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SKELSSE
+#include <xmmintrin.h>
+#endif
+
+VAR(skelsimd, 0, 1, 1);
+
+#ifdef SKELSSE
+static inline void accumulatebonesse(dualquat &d, const dualquat &s, float k)
+{
+    __m128 mk = _mm_set1_ps(d.real.dot(s.real) < 0 ? -k : k);
+    _mm_storeu_ps(d.real.v, _mm_add_ps(_mm_loadu_ps(d.real.v), _mm_mul_ps(_mm_loadu_ps(s.real.v), mk)));
+    _mm_storeu_ps(d.dual.v, _mm_add_ps(_mm_loadu_ps(d.dual.v), _mm_mul_ps(_mm_loadu_ps(s.dual.v), mk)));
+}
+
+static inline void accumulatebonesse(matrix3x4 &d, const matrix3x4 &s, float k)
+{
+    __m128 mk = _mm_set1_ps(k);
+    _mm_storeu_ps(d.a.v, _mm_add_ps(_mm_loadu_ps(d.a.v), _mm_mul_ps(_mm_loadu_ps(s.a.v), mk)));
+    _mm_storeu_ps(d.b.v, _mm_add_ps(_mm_loadu_ps(d.b.v), _mm_mul_ps(_mm_loadu_ps(s.b.v), mk)));
+    _mm_storeu_ps(d.c.v, _mm_add_ps(_mm_loadu_ps(d.c.v), _mm_mul_ps(_mm_loadu_ps(s.c.v), mk)));
+}
+
+static inline void mulbonesse(matrix3x4 &d, const matrix3x4 &m, const matrix3x4 &n)
+{
+    __m128 na = _mm_loadu_ps(n.a.v), nb = _mm_loadu_ps(n.b.v), nc = _mm_loadu_ps(n.c.v);
+    #define MULBONEROW(row) \
+        _mm_storeu_ps(d.row.v, _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(na, _mm_set1_ps(m.row.x)), _mm_mul_ps(nb, _mm_set1_ps(m.row.y))), _mm_mul_ps(nc, _mm_set1_ps(m.row.z))), _mm_setr_ps(0, 0, 0, m.row.w)));
+    MULBONEROW(a);
+    MULBONEROW(b);
+    MULBONEROW(c);
+    #undef MULBONEROW
+}
+
+// transposes the rows so a vertex transform becomes a sum of scaled columns
+static inline void loadbonecolumns(const matrix3x4 &m, __m128 &cx, __m128 &cy, __m128 &cz, __m128 &cw)
+{
+    cx = _mm_loadu_ps(m.a.v);
+    cy = _mm_loadu_ps(m.b.v);
+    cz = _mm_loadu_ps(m.c.v);
+    cw = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+}
+
+static inline __m128 transformnormalsse(__m128 cx, __m128 cy, __m128 cz, const vec &v)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(v.x)), _mm_mul_ps(cy, _mm_set1_ps(v.y))), _mm_mul_ps(cz, _mm_set1_ps(v.z)));
+}
+
+static inline void storevecsse(vec &v, __m128 r)
+{
+    _mm_storel_pi((__m64 *)v.v, r);
+    _mm_store_ss(&v.z, _mm_movehl_ps(r, r));
+}
+#endif
+
+template<class B> static inline void accumulatebone(B &d, const B &s, float k)
+{
+#ifdef SKELSSE
+    if(skelsimd) { accumulatebonesse(d, s, k); return; }
+#endif
+    d.accumulate(s, k);
+}
+
+static inline void mulbone(matrix3x4 &d, const matrix3x4 &m, const matrix3x4 &n)
+{
+#ifdef SKELSSE
+    if(skelsimd) { mulbonesse(d, m, n); return; }
+#endif
+    d.mul(m, n);
+}
+
 #define BONEMASK_NOT  0x8000
 #define BONEMASK_END  0xFFFF
 #define BONEMASK_BONE 0x7FFF
@@ -445,6 +520,48 @@ struct skelmodel : animmodel
             #undef IPLOOP
         }
 
+#ifdef SKELSSE
+        void interpverts(const matrix3x4 * RESTRICT mdata1, const matrix3x4 * RESTRICT mdata2, bool norms, bool tangents, void * RESTRICT vdata, skin &s)
+        {
+            if(!skelsimd) { interpverts<matrix3x4>(mdata1, mdata2, norms, tangents, vdata, s); return; }
+
+            const int blendoffset = ((skelmeshgroup *)group)->skel->numgpubones;
+            mdata2 -= blendoffset;
+
+            // neighbouring verts mostly share a bone, so only re-transpose when it changes
+            const matrix3x4 *lastm = NULL;
+            __m128 cx = _mm_setzero_ps(), cy = cx, cz = cx, cw = cx;
+            #define IPLOOP(type, dosetup, dotransform) \
+                loopi(numverts) \
+                { \
+                    const vert &src = verts[i]; \
+                    type &dst = ((type * RESTRICT)vdata)[i]; \
+                    dosetup; \
+                    const matrix3x4 *m = &(src.interpindex < blendoffset ? mdata1 : mdata2)[src.interpindex]; \
+                    if(m != lastm) { loadbonecolumns(*m, cx, cy, cz, cw); lastm = m; } \
+                    storevecsse(dst.pos, _mm_add_ps(transformnormalsse(cx, cy, cz, src.pos), cw)); \
+                    dotransform; \
+                }
+
+            if(tangents)
+            {
+                if(bumpverts)
+                {
+                    IPLOOP(vvertbump, bumpvert &bsrc = bumpverts[i],
+                    {
+                        storevecsse(dst.norm, transformnormalsse(cx, cy, cz, src.norm));
+                        storevecsse(dst.tangent, transformnormalsse(cx, cy, cz, bsrc.tangent));
+                    });
+                }
+                else { IPLOOP(vvertbump, , storevecsse(dst.norm, transformnormalsse(cx, cy, cz, src.norm))); }
+            }
+            else if(norms) { IPLOOP(vvertn, , storevecsse(dst.norm, transformnormalsse(cx, cy, cz, src.norm))); }
+            else { IPLOOP(vvert, , ); }
+
+            #undef IPLOOP
+        }
+#endif
+
         void setshader(Shader *s)
         {
             skelmeshgroup *g = (skelmeshgroup *)group;
@@ -1004,11 +1121,11 @@ struct skelmodel : animmodel
             const framedata &f = partframes[partmask[bone]]; \
             dualquat d; \
             (d = f.fr1[bone]).mul((1-s.cur.t)*s.interp); \
-            d.accumulate(f.fr2[bone], s.cur.t*s.interp); \
+            accumulatebone(d, f.fr2[bone], s.cur.t*s.interp); \
             if(s.interp<1) \
             { \
-                d.accumulate(f.pfr1[bone], (1-s.prev.t)*(1-s.interp)); \
-                d.accumulate(f.pfr2[bone], s.prev.t*(1-s.interp)); \
+                accumulatebone(d, f.pfr1[bone], (1-s.prev.t)*(1-s.interp)); \
+                accumulatebone(d, f.pfr2[bone], s.prev.t*(1-s.interp)); \
             }
 
         #define INTERPBONES(outbody, rotbody) \
@@ -1058,7 +1175,7 @@ struct skelmodel : animmodel
             {
                 matrix3x4 m(d);
                 if(b.interpparent<0) sc.mdata[b.interpindex] = m;
-                else sc.mdata[b.interpindex].mul(sc.mdata[b.interpparent], m);
+                else mulbone(sc.mdata[b.interpindex], sc.mdata[b.interpparent], m);
             },
             {
                 sc.mdata[b.interpindex].mulorient(matrix3x3(angle*RAD, axis), b.base);
@@ -1659,6 +1776,152 @@ struct skelmodel : animmodel
             delete[] remap;
         }
 
+        skelanimspec *addskelanimframes(const char *filename, const dualquat *frames, int numframes)
+        {
+            dualquat *framebones = new dualquat[(skel->numframes+numframes)*skel->numbones];
+            if(skel->framebones)
+            {
+                memcpy(framebones, skel->framebones, skel->numframes*skel->numbones*sizeof(dualquat));
+                delete[] skel->framebones;
+            }
+            memcpy(&framebones[skel->numframes*skel->numbones], frames, numframes*skel->numbones*sizeof(dualquat));
+            skel->framebones = framebones;
+            skelanimspec *sa = &skel->addskelanim(filename);
+            sa->frame = skel->numframes;
+            sa->range = numframes;
+            skel->numframes += numframes;
+            return sa;
+        }
+
+        // bones are only stored when this group created the skeleton, otherwise just the meshes and their blend combos
+        void savemeshcache(stream *f, bool bones)
+        {
+            int numbones = bones ? skel->numbones : 0;
+            putmodelcache(f, numbones);
+            loopi(numbones)
+            {
+                boneinfo &b = skel->bones[i];
+                putmodelcachestring(f, b.name);
+                putmodelcache(f, b.parent);
+                putmodelcache(f, b.base);
+            }
+            putmodelcache(f, meshes.length());
+            loopv(meshes)
+            {
+                skelmesh &m = *(skelmesh *)meshes[i];
+                putmodelcachestring(f, m.name);
+                putmodelcache(f, m.numverts);
+                putmodelcache(f, m.numtris);
+                putmodelcache(f, m.maxweights);
+                f->write(m.verts, m.numverts*sizeof(vert));
+                f->write(m.tris, m.numtris*sizeof(tri));
+            }
+            putmodelcache(f, blendcombos.length());
+            f->write(blendcombos.getbuf(), blendcombos.length()*sizeof(blendcombo));
+            f->write(numblends, sizeof(numblends));
+        }
+
+        void clearmeshcache(bool bones)
+        {
+            meshes.deletecontents();
+            blendcombos.setsize(0);
+            memset(numblends, 0, sizeof(numblends));
+            if(bones)
+            {
+                DELETEA(skel->bones);
+                skel->numbones = 0;
+            }
+        }
+
+        template<class M> bool loadmeshcache(ucharbuf &p, bool bones)
+        {
+            int numbones = getmodelcache<int>(p);
+            if(bones ? numbones <= 0 || numbones > p.remaining()/int(sizeof(dualquat)) : numbones != 0) return false;
+            if(bones)
+            {
+                skel->numbones = numbones;
+                skel->bones = new boneinfo[numbones];
+                loopi(numbones)
+                {
+                    boneinfo &b = skel->bones[i];
+                    b.name = getmodelcachestring(p);
+                    b.parent = getmodelcache<int>(p);
+                    p.get((uchar *)&b.base, sizeof(dualquat));
+                    (b.invbase = b.base).invert();
+                }
+                loopi(numbones) if(skel->bones[i].parent < -1 || skel->bones[i].parent >= numbones) { clearmeshcache(bones); return false; }
+                skel->linkchildren();
+            }
+            int nummeshes = getmodelcache<int>(p);
+            loopi(nummeshes)
+            {
+                if(p.overread()) break;
+                M *m = new M;
+                m->group = this;
+                meshes.add(m);
+                m->name = getmodelcachestring(p);
+                m->numverts = getmodelcache<int>(p);
+                m->numtris = getmodelcache<int>(p);
+                m->maxweights = getmodelcache<int>(p);
+                m->verts = getmodelcachearray<vert>(p, m->numverts);
+                m->tris = getmodelcachearray<tri>(p, m->numtris);
+            }
+            int numcombos = getmodelcache<int>(p);
+            if(numcombos > 0 && numcombos <= p.remaining()/int(sizeof(blendcombo)))
+            {
+                blendcombos.setsize(0);
+                p.get((uchar *)blendcombos.pad(numcombos), numcombos*sizeof(blendcombo));
+            }
+            p.get((uchar *)numblends, sizeof(numblends));
+            bool valid = !p.overread() && meshes.length() == nummeshes && blendcombos.length() == numcombos;
+            loopv(meshes)
+            {
+                skelmesh &m = *(skelmesh *)meshes[i];
+                if(!valid) break;
+                loopj(m.numverts) if(!blendcombos.inrange(m.verts[j].blend)) { valid = false; break; }
+                loopj(m.numtris) loopk(3) if(m.tris[j].vert[k] >= m.numverts) { valid = false; break; }
+            }
+            if(!valid) clearmeshcache(bones);
+            return valid;
+        }
+
+        // anim frames depend on the bind pose, the first loaded frame and any adjustments, so those go into the cache key
+        uint animcachesalt(const void *adjustments, int adjustlen)
+        {
+            uint crc = crc32(0, (const Bytef *)&skel->numbones, sizeof(int));
+            loopi(skel->numbones)
+            {
+                crc = crc32(crc, (const Bytef *)&skel->bones[i].parent, sizeof(int));
+                crc = crc32(crc, (const Bytef *)&skel->bones[i].base, sizeof(dualquat));
+            }
+            if(skel->numframes) crc = crc32(crc, (const Bytef *)skel->framebones, skel->numbones*sizeof(dualquat));
+            if(adjustlen) crc = crc32(crc, (const Bytef *)adjustments, adjustlen);
+            return crc;
+        }
+
+        skelanimspec *loadanimcache(const char *filename, const char *key)
+        {
+            if(skel->numbones <= 0) return NULL;
+            ucharbuf p;
+            uchar *buf = loadmodelcache(key, p);
+            if(!buf) return NULL;
+            skelanimspec *sa = NULL;
+            int numframes = getmodelcache<int>(p), framesize = skel->numbones*sizeof(dualquat);
+            if(numframes > 0 && !p.overread() && p.remaining() == numframes*framesize)
+                sa = addskelanimframes(filename, (const dualquat *)p.subbuf(p.remaining()).buf, numframes);
+            delete[] buf;
+            return sa;
+        }
+
+        void saveanimcache(const char *key, skelanimspec *sa)
+        {
+            stream *f = savemodelcache(key);
+            if(!f) return;
+            putmodelcache(f, sa->range);
+            f->write(&skel->framebones[sa->frame*skel->numbones], sa->range*skel->numbones*sizeof(dualquat));
+            delete f;
+        }
+
         int remapblend(int blend)
         {
             const blendcombo &c = blendcombos[blend];
@@ -1670,11 +1933,11 @@ struct skelmodel : animmodel
         {
             d = bdata[c.interpbones[0]];
             d.mul(c.weights[0]);
-            d.accumulate(bdata[c.interpbones[1]], c.weights[1]);
+            accumulatebone(d, bdata[c.interpbones[1]], c.weights[1]);
             if(c.weights[2])
             {
-                d.accumulate(bdata[c.interpbones[2]], c.weights[2]);
-                if(c.weights[3]) d.accumulate(bdata[c.interpbones[3]], c.weights[3]);
+                accumulatebone(d, bdata[c.interpbones[2]], c.weights[2]);
+                if(c.weights[3]) accumulatebone(d, bdata[c.interpbones[3]], c.weights[3]);
             }
         }
 
@@ -1709,6 +1972,108 @@ struct skelmodel : animmodel
             }
         }
 
+        void benchpose(int instance, bool mat, const uchar *partmask, int numanimparts, skelcacheentry &sc, blendcacheentry &bc, part *p, vvertn *vdata)
+        {
+            animstate as[MAXANIMPARTS];
+            loopi(numanimparts)
+            {
+                animstate &a = as[i];
+                a.owner = p;
+                a.cur.anim = 0;
+                a.cur.fr1 = (instance + i) % skel->numframes;
+                a.cur.fr2 = (a.cur.fr1 + 1) % skel->numframes;
+                a.cur.t = (instance%8 + 0.5f)/8;
+                a.prev = a.cur;
+                a.interp = 1;
+            }
+            float pitch = instance%90 - 45;
+            vec axis(0, 0, 1), forward(0, 1, 0);
+            if(mat)
+            {
+                skel->interpmatbones(as, pitch, axis, forward, numanimparts, partmask, sc);
+                blendmatbones(sc, bc);
+            }
+            else
+            {
+                skel->interpbones(as, pitch, axis, forward, numanimparts, partmask, sc);
+                blendbones(sc, bc);
+            }
+            loopv(meshes)
+            {
+                skelmesh &m = *(skelmesh *)meshes[i];
+                if(mat) m.interpverts(sc.mdata, bc.mdata, true, false, vdata, p->skins[i]);
+                else m.interpverts(sc.bdata, bc.bdata, true, false, vdata, p->skins[i]);
+                vdata += m.numverts;
+            }
+        }
+
+        // skins numinstances poses on the CPU with the scalar and SIMD kernels, for both matrix and dual quaternion bones;
+        // the blend state the CPU path needs is set up here and restored afterwards so GPU skinning is left undisturbed
+        void benchskin(part *p, const uchar *partmask, int numinstances, uint millis[2][2], int &mismatches)
+        {
+            if(!skel->numframes || !partmask) return;
+            int oldvblends = vblends, numverts = 0;
+            vector<int> oldcombos, oldverts;
+            vblends = 0;
+            loopv(blendcombos)
+            {
+                blendcombo &c = blendcombos[i];
+                oldcombos.add(c.interpindex);
+                c.interpindex = c.weights[1] ? skel->numgpubones + vblends++ : -1;
+            }
+            loopv(meshes)
+            {
+                skelmesh &m = *(skelmesh *)meshes[i];
+                loopj(m.numverts)
+                {
+                    oldverts.add(m.verts[j].interpindex);
+                    m.verts[j].interpindex = remapblend(m.verts[j].blend);
+                }
+                numverts += m.numverts;
+            }
+
+            int oldsimd = skelsimd;
+            skelcacheentry sc;
+            blendcacheentry bc;
+            vvertn *vdata[2] = { new vvertn[numverts], new vvertn[numverts] };
+            loopk(2) loopl(2)
+            {
+                skelsimd = l;
+                Uint32 start = SDL_GetTicks();
+                loopi(numinstances) benchpose(i, k!=0, partmask, p->numanimparts, sc, bc, p, vdata[0]);
+                millis[k][l] += SDL_GetTicks() - start;
+            }
+            loopk(2) loopi(numinstances)
+            {
+                loopl(2)
+                {
+                    skelsimd = l;
+                    benchpose(i, k!=0, partmask, p->numanimparts, sc, bc, p, vdata[l]);
+                }
+                loopj(numverts)
+                {
+                    const vvertn &a = vdata[0][j], &b = vdata[1][j];
+                    if(a.pos != b.pos || a.norm != b.norm) mismatches++;
+                }
+            }
+            skelsimd = oldsimd;
+            delete[] vdata[0];
+            delete[] vdata[1];
+            DELETEA(sc.bdata);
+            DELETEA(sc.mdata);
+            DELETEA(bc.bdata);
+            DELETEA(bc.mdata);
+
+            vblends = oldvblends;
+            loopv(blendcombos) blendcombos[i].interpindex = oldcombos[i];
+            int index = 0;
+            loopv(meshes)
+            {
+                skelmesh &m = *(skelmesh *)meshes[i];
+                loopj(m.numverts) m.verts[j].interpindex = oldverts[index++];
+            }
+        }
+
         void cleanup()
         {
             loopi(MAXBLENDCACHE)
@@ -1945,6 +2310,15 @@ struct skelmodel : animmodel
     }
     
     bool skeletal() const { return true; }
+
+    void benchskin(int numinstances, uint millis[2][2], int &mismatches)
+    {
+        loopv(parts)
+        {
+            skelpart *p = (skelpart *)parts[i];
+            if(p->meshes) ((skelmeshgroup *)p->meshes)->benchskin(p, p->partmask, numinstances, millis, mismatches);
+        }
+    }
 };
 
 struct skeladjustment
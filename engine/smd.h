@@ -246,6 +246,22 @@ struct smd : skelmodel, skelloader<smd>
 
         bool loadmesh(const char *filename)
         {
+            string cachekey;
+            bool bones = skel->numbones <= 0,
+                 cached = (!bones || skel->shared <= 1) && modelcachekey("smdmesh", filename, filename, skel->numbones, cachekey);
+            if(cached)
+            {
+                ucharbuf p;
+                uchar *buf = loadmodelcache(cachekey, p);
+                if(buf)
+                {
+                    bool loaded = loadmeshcache<smdmesh>(p, bones);
+                    if(loaded && p.remaining()) { clearmeshcache(bones); loaded = false; }
+                    delete[] buf;
+                    if(loaded) return true;
+                }
+            }
+
             stream *f = openfile(filename, "r");
             if(!f) return false;
             
@@ -289,6 +305,12 @@ struct smd : skelmodel, skelloader<smd>
 
             sortblendcombos();
 
+            if(cached)
+            {
+                stream *cf = savemodelcache(cachekey);
+                if(cf) { savemeshcache(cf, bones); delete cf; }
+            }
+
             delete f;
             return true;
         }
@@ -350,6 +372,10 @@ struct smd : skelmodel, skelloader<smd>
             skelanimspec *sa = skel->findskelanim(filename);
             if(sa || skel->numbones <= 0) return sa;
 
+            string cachekey;
+            bool cached = modelcachekey("smdanim", filename, filename, animcachesalt(adjustments.getbuf(), adjustments.length()*sizeof(skeladjustment)), cachekey);
+            if(cached && (sa = loadanimcache(filename, cachekey))) return sa;
+
             stream *f = openfile(filename, "r");
             if(!f) return NULL;
 
@@ -378,21 +404,12 @@ struct smd : skelmodel, skelloader<smd>
                     skipsection(f, buf, sizeof(buf));
             }
             int numframes = animbones.length() / skel->numbones;
-            dualquat *framebones = new dualquat[(skel->numframes+numframes)*skel->numbones];             
-            if(skel->framebones)
-            {
-                memcpy(framebones, skel->framebones, skel->numframes*skel->numbones*sizeof(dualquat));
-                delete[] skel->framebones;
-            }
-            memcpy(&framebones[skel->numframes*skel->numbones], animbones.getbuf(), numframes*skel->numbones*sizeof(dualquat));
-            skel->framebones = framebones;
-            sa = &skel->addskelanim(filename);
-            sa->frame = skel->numframes;
-            sa->range = numframes;
-            skel->numframes += numframes;
+            sa = addskelanimframes(filename, animbones.getbuf(), numframes);
 
             delete f;
 
+            if(cached) saveanimcache(cachekey, sa);
+
             return sa;
         }
 
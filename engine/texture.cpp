@@ -26,10 +26,66 @@
 #define BPP 4
 #include "scale.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXSSE
+#include <emmintrin.h>
+#endif
+
+VAR(texsimd, 0, 1, 1);
+
+#ifdef TEXSSE
+static void halvetexture1sse(uchar *src, uint sw, uint sh, uint stride, uchar *dst)
+{
+    const __m128i lomask = _mm_set1_epi16(0xFF);
+    for(uchar *yend = &src[sh*stride]; src < yend; src += stride)
+    {
+        uchar *xend = &src[stride];
+        for(; src + 16 <= xend; src += 16, dst += 8)
+        {
+            __m128i r0 = _mm_loadu_si128((const __m128i *)src), r1 = _mm_loadu_si128((const __m128i *)&src[stride]),
+                    sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(r0, lomask), _mm_srli_epi16(r0, 8)),
+                                        _mm_add_epi16(_mm_and_si128(r1, lomask), _mm_srli_epi16(r1, 8))),
+                    avg = _mm_srli_epi16(sum, 2);
+            _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(avg, avg));
+        }
+        for(; src < xend; src += 2, dst++) dst[0] = (uint(src[0]) + uint(src[1]) + uint(src[stride]) + uint(src[stride+1]))>>2;
+    }
+}
+
+static void halvetexture4sse(uchar *src, uint sw, uint sh, uint stride, uchar *dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for(uchar *yend = &src[sh*stride]; src < yend; src += stride)
+    {
+        uchar *xend = &src[stride];
+        for(; src + 32 <= xend; src += 32, dst += 16)
+        {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)src), a1 = _mm_loadu_si128((const __m128i *)&src[16]),
+                    b0 = _mm_loadu_si128((const __m128i *)&src[stride]), b1 = _mm_loadu_si128((const __m128i *)&src[stride+16]),
+                    s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero)),
+                    s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero)),
+                    s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero)),
+                    s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero)),
+                    p0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1)),
+                    p1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+            _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(_mm_srli_epi16(p0, 2), _mm_srli_epi16(p1, 2)));
+        }
+        for(; src < xend; src += 8, dst += 4) loopk(4) dst[k] = (uint(src[k]) + uint(src[k+4]) + uint(src[stride+k]) + uint(src[stride+k+4]))>>2;
+    }
+}
+#endif
+
 static void scaletexture(uchar *src, uint sw, uint sh, uint bpp, uint pitch, uchar *dst, uint dw, uint dh)
 {
     if(sw == dw*2 && sh == dh*2)
     {
+#ifdef TEXSSE
+        if(texsimd && !(pitch%(2*bpp))) switch(bpp)
+        {
+            case 1: return halvetexture1sse(src, sw, sh, pitch, dst);
+            case 4: return halvetexture4sse(src, sw, sh, pitch, dst);
+        }
+#endif
         switch(bpp)
         {
             case 1: return halvetexture1(src, sw, sh, pitch, dst);
@@ -267,8 +323,55 @@ void texoffset(ImageData &s, int xoffset, int yoffset)
     s.replace(d);
 }
 
+#ifdef TEXSSE
+static void texmadsse(ImageData &s, const vec &mul, const vec &add)
+{
+    // channel pattern repeats every 12 bytes for any bpp, so keep 3 lanes of multipliers
+    int maxk = min(int(s.bpp), 3);
+    __m128 vmul[3], vadd[3];
+    loopi(3)
+    {
+        float m[4], a[4];
+        loopj(4)
+        {
+            int k = (4*i + j)%s.bpp;
+            m[j] = k < maxk ? mul[k] : 1.0f;
+            a[j] = k < maxk ? 255*add[k] : 0.0f;
+        }
+        vmul[i] = _mm_loadu_ps(m);
+        vadd[i] = _mm_loadu_ps(a);
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 fzero = _mm_setzero_ps(), fmax = _mm_set1_ps(255.0f);
+    int len = s.w*s.bpp;
+    uchar *row = s.data;
+    loop(y, s.h)
+    {
+        int x = 0;
+        for(; x + 48 <= len; x += 48) loopi(3)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)&row[x+16*i]), lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero), c[4];
+            __m128 f[4] = { _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)),
+                            _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)) };
+            loopj(4)
+            {
+                int q = (4*i + j)%3;
+                c[j] = _mm_cvttps_epi32(_mm_max_ps(fzero, _mm_min_ps(_mm_add_ps(_mm_mul_ps(f[j], vmul[q]), vadd[q]), fmax)));
+            }
+            _mm_storeu_si128((__m128i *)&row[x+16*i], _mm_packus_epi16(_mm_packs_epi32(c[0], c[1]), _mm_packs_epi32(c[2], c[3])));
+        }
+        for(uchar *dst = &row[x], *end = &row[len]; dst < end; dst += s.bpp)
+            loopk(maxk) dst[k] = uchar(clamp(dst[k]*mul[k] + 255*add[k], 0.0f, 255.0f));
+        row += s.pitch;
+    }
+}
+#endif
+
 void texmad(ImageData &s, const vec &mul, const vec &add)
 {
+#ifdef TEXSSE
+    if(texsimd) { texmadsse(s, mul, add); return; }
+#endif
     int maxk = min(int(s.bpp), 3);
     writetex(s,
         loopk(maxk) dst[k] = uchar(clamp(dst[k]*mul[k] + 255*add[k], 0.0f, 255.0f));
@@ -369,8 +472,57 @@ void texgrey(ImageData &s)
     s.replace(d);
 }
 
+#ifdef TEXSSE
+// exact x/255 for x <= 255*255
+static inline __m128i div255sse(__m128i x)
+{
+    return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+}
+
+template<int bpp>
+static void texpremulsse(ImageData &s)
+{
+    const __m128i zero = _mm_setzero_si128(), alphamask = bpp > 2 ? _mm_set1_epi32(int(0xFF000000)) : _mm_set1_epi16(0xFF00);
+    int len = s.w*bpp;
+    uchar *row = s.data;
+    loop(y, s.h)
+    {
+        int x = 0;
+        for(; x + 16 <= len; x += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)&row[x]), lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero), alo, ahi;
+            if(bpp > 2)
+            {
+                alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            }
+            else
+            {
+                alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+                ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+            }
+            __m128i c = _mm_packus_epi16(div255sse(_mm_mullo_epi16(lo, alo)), div255sse(_mm_mullo_epi16(hi, ahi)));
+            _mm_storeu_si128((__m128i *)&row[x], _mm_or_si128(_mm_andnot_si128(alphamask, c), _mm_and_si128(alphamask, v)));
+        }
+        for(uchar *dst = &row[x], *end = &row[len]; dst < end; dst += bpp)
+        {
+            uint alpha = dst[bpp-1];
+            loopk(bpp-1) dst[k] = uchar((uint(dst[k])*alpha)/255);
+        }
+        row += s.pitch;
+    }
+}
+#endif
+
 void texpremul(ImageData &s)
 {
+#ifdef TEXSSE
+    if(texsimd) switch(s.bpp)
+    {
+        case 2: texpremulsse<2>(s); return;
+        case 4: texpremulsse<4>(s); return;
+    }
+#endif
     switch(s.bpp)
     {
         case 2: 
@@ -896,75 +1048,82 @@ void texnormal(ImageData &s, int emphasis)
     s.replace(d);
 }
 
+static const int blurmatrix3x3[9] =
+{
+    0x10, 0x20, 0x10,
+    0x20, 0x40, 0x20,
+    0x10, 0x20, 0x10
+};
+static const int blurmatrix5x5[25] =
+{
+    0x05, 0x05, 0x09, 0x05, 0x05,
+    0x05, 0x0A, 0x14, 0x0A, 0x05,
+    0x09, 0x14, 0x28, 0x14, 0x09,
+    0x05, 0x0A, 0x14, 0x0A, 0x05,
+    0x05, 0x05, 0x09, 0x05, 0x05
+};
+
+template<int n, int bpp, bool normals>
+static inline void blurpixel(int x, int y, int w, int h, uchar *dst, const uchar *src)
+{
+    const int *mat = n > 1 ? blurmatrix5x5 : blurmatrix3x3;
+    const int mstride = 2*n + 1,
+              mstartoffset = n*(mstride + 1),
+              stride = bpp*w,
+              startoffset = n*bpp,
+              nextoffset1 = stride + mstride*bpp,
+              nextoffset2 = stride - mstride*bpp;
+    int dr = 0, dg = 0, db = 0;
+    const uchar *p = src - startoffset;
+    const int *m = mat + mstartoffset;
+    for(int t = y; t >= y-n; t--, p -= nextoffset1, m -= mstride)
+    {
+        if(t < 0) p += stride;
+        int a = 0;
+        if(n > 1) { a += m[-2]; if(x >= 2) { dr += p[0] * a; dg += p[1] * a; db += p[2] * a; a = 0; } p += bpp; }
+        a += m[-1]; if(x >= 1) { dr += p[0] * a; dg += p[1] * a; db += p[2] * a; a = 0; } p += bpp;
+        int cr = p[0], cg = p[1], cb = p[2]; a += m[0]; dr += cr * a; dg += cg * a; db += cb * a; p += bpp;
+        if(x+1 < w) { cr = p[0]; cg = p[1]; cb = p[2]; } dr += cr * m[1]; dg += cg * m[1]; db += cb * m[1]; p += bpp;
+        if(n > 1) { if(x+2 < w) { cr = p[0]; cg = p[1]; cb = p[2]; } dr += cr * m[2]; dg += cg * m[2]; db += cb * m[2]; p += bpp; }
+    }
+    p = src - startoffset + stride;
+    m = mat + mstartoffset + mstride;
+    for(int t = y+1; t <= y+n; t++, p += nextoffset2, m += mstride)
+    {
+        if(t >= h) p -= stride;
+        int a = 0;
+        if(n > 1) { a += m[-2]; if(x >= 2) { dr += p[0] * a; dg += p[1] * a; db += p[2] * a; a = 0; } p += bpp; }
+        a += m[-1]; if(x >= 1) { dr += p[0] * a; dg += p[1] * a; db += p[2] * a; a = 0; } p += bpp;
+        int cr = p[0], cg = p[1], cb = p[2]; a += m[0]; dr += cr * a; dg += cg * a; db += cb * a; p += bpp;
+        if(x+1 < w) { cr = p[0]; cg = p[1]; cb = p[2]; } dr += cr * m[1]; dg += cg * m[1]; db += cb * m[1]; p += bpp;
+        if(n > 1) { if(x+2 < w) { cr = p[0]; cg = p[1]; cb = p[2]; } dr += cr * m[2]; dg += cg * m[2]; db += cb * m[2]; p += bpp; }
+    }
+    if(normals)
+    {
+        vec v(dr-0x7F80, dg-0x7F80, db-0x7F80);
+        float mag = 127.5f/v.magnitude();
+        dst[0] = uchar(v.x*mag + 127.5f);
+        dst[1] = uchar(v.y*mag + 127.5f);
+        dst[2] = uchar(v.z*mag + 127.5f);
+    }
+    else 
+    {
+        dst[0] = dr>>8;
+        dst[1] = dg>>8;
+        dst[2] = db>>8;
+    }
+    if(bpp > 3) dst[3] = src[3];
+}
+
 template<int n, int bpp, bool normals>
 static void blurtexture(int w, int h, uchar *dst, const uchar *src, int margin)
 {
-    static const int matrix3x3[9] =
-    {
-        0x10, 0x20, 0x10,
-        0x20, 0x40, 0x20,
-        0x10, 0x20, 0x10
-    };
-    static const int matrix5x5[25] =
-    {
-        0x05, 0x05, 0x09, 0x05, 0x05,
-        0x05, 0x0A, 0x14, 0x0A, 0x05,
-        0x09, 0x14, 0x28, 0x14, 0x09,
-        0x05, 0x0A, 0x14, 0x0A, 0x05,
-        0x05, 0x05, 0x09, 0x05, 0x05
-    };
-    const int *mat = n > 1 ? matrix5x5 : matrix3x3;
-    int mstride = 2*n + 1,
-        mstartoffset = n*(mstride + 1),
-        stride = bpp*w,
-        startoffset = n*bpp,
-        nextoffset1 = stride + mstride*bpp,
-        nextoffset2 = stride - mstride*bpp;
-    src += margin*(stride + bpp);
+    src += margin*(bpp*w + bpp);
     for(int y = margin; y < h-margin; y++)
     {
         for(int x = margin; x < w-margin; x++)
         {
-            int dr = 0, dg = 0, db = 0;
-            const uchar *p = src - startoffset;
-            const int *m = mat + mstartoffset;
-            for(int t = y; t >= y-n; t--, p -= nextoffset1, m -= mstride)
-            {
-                if(t < 0) p += stride;
-                int a = 0;
-                if(n > 1) { a += m[-2]; if(x >= 2) { dr += p[0] * a; dg += p[1] * a; db += p[2] * a; a = 0; } p += bpp; }
-                a += m[-1]; if(x >= 1) { dr += p[0] * a; dg += p[1] * a; db += p[2] * a; a = 0; } p += bpp;
-                int cr = p[0], cg = p[1], cb = p[2]; a += m[0]; dr += cr * a; dg += cg * a; db += cb * a; p += bpp;
-                if(x+1 < w) { cr = p[0]; cg = p[1]; cb = p[2]; } dr += cr * m[1]; dg += cg * m[1]; db += cb * m[1]; p += bpp;
-                if(n > 1) { if(x+2 < w) { cr = p[0]; cg = p[1]; cb = p[2]; } dr += cr * m[2]; dg += cg * m[2]; db += cb * m[2]; p += bpp; }
-            }
-            p = src - startoffset + stride;
-            m = mat + mstartoffset + mstride;
-            for(int t = y+1; t <= y+n; t++, p += nextoffset2, m += mstride)
-            {
-                if(t >= h) p -= stride;
-                int a = 0;
-                if(n > 1) { a += m[-2]; if(x >= 2) { dr += p[0] * a; dg += p[1] * a; db += p[2] * a; a = 0; } p += bpp; }
-                a += m[-1]; if(x >= 1) { dr += p[0] * a; dg += p[1] * a; db += p[2] * a; a = 0; } p += bpp;
-                int cr = p[0], cg = p[1], cb = p[2]; a += m[0]; dr += cr * a; dg += cg * a; db += cb * a; p += bpp;
-                if(x+1 < w) { cr = p[0]; cg = p[1]; cb = p[2]; } dr += cr * m[1]; dg += cg * m[1]; db += cb * m[1]; p += bpp;
-                if(n > 1) { if(x+2 < w) { cr = p[0]; cg = p[1]; cb = p[2]; } dr += cr * m[2]; dg += cg * m[2]; db += cb * m[2]; p += bpp; }
-            }
-            if(normals)
-            {
-                vec v(dr-0x7F80, dg-0x7F80, db-0x7F80);
-                float mag = 127.5f/v.magnitude();
-                dst[0] = uchar(v.x*mag + 127.5f);
-                dst[1] = uchar(v.y*mag + 127.5f);
-                dst[2] = uchar(v.z*mag + 127.5f);
-            }
-            else 
-            {
-                dst[0] = dr>>8;
-                dst[1] = dg>>8;
-                dst[2] = db>>8;
-            }
-            if(bpp > 3) dst[3] = src[3];
+            blurpixel<n, bpp, normals>(x, y, w, h, dst, src);
             dst += bpp;
             src += bpp;
         }
@@ -972,8 +1131,60 @@ static void blurtexture(int w, int h, uchar *dst, const uchar *src, int margin)
     }
 }
 
+#ifdef TEXSSE
+// filters the interior of each row 16 bytes at a time, leaving the clamped border pixels to blurpixel
+template<int n, int bpp>
+static void blurtexturesse(int w, int h, uchar *dst, const uchar *src, int margin)
+{
+    const int *mat = n > 1 ? blurmatrix5x5 : blurmatrix3x3;
+    const int mstride = 2*n + 1, stride = bpp*w, x1 = max(margin, n), x2 = min(w-margin, w-n);
+    const __m128i zero = _mm_setzero_si128(), alphamask = _mm_set1_epi32(int(0xFF000000));
+    __m128i weights[25];
+    loopi(mstride*mstride) weights[i] = _mm_set1_epi16(mat[i]);
+    src += margin*(stride + bpp);
+    for(int y = margin; y < h-margin; y++)
+    {
+        int x = margin;
+        if(y >= n && y+n < h && x1 < x2)
+        {
+            for(; x < x1; x++, dst += bpp, src += bpp) blurpixel<n, bpp, false>(x, y, w, h, dst, src);
+            const uchar *start = src, *end = src + (x2 - x1)*bpp;
+            for(; src + 16 <= end; src += 16, dst += 16)
+            {
+                __m128i lo = zero, hi = zero;
+                const __m128i *weight = weights;
+                for(int dy = -n; dy <= n; dy++) for(int dx = -n; dx <= n; dx++, weight++)
+                {
+                    __m128i v = _mm_loadu_si128((const __m128i *)&src[dy*stride + dx*bpp]);
+                    lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), *weight));
+                    hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), *weight));
+                }
+                __m128i c = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+                if(bpp > 3) c = _mm_or_si128(_mm_andnot_si128(alphamask, c), _mm_and_si128(alphamask, _mm_loadu_si128((const __m128i *)src)));
+                _mm_storeu_si128((__m128i *)dst, c);
+            }
+            int done = (src - start)/bpp, partial = (src - start)%bpp;
+            x += done;
+            src -= partial;
+            dst -= partial;
+        }
+        for(; x < w-margin; x++, dst += bpp, src += bpp) blurpixel<n, bpp, false>(x, y, w, h, dst, src);
+        src += 2*margin*bpp;
+    }
+}
+#endif
+
 void blurtexture(int n, int bpp, int w, int h, uchar *dst, const uchar *src, int margin)
 {
+#ifdef TEXSSE
+    if(texsimd) switch((clamp(n, 1, 2)<<4) | bpp)
+    {
+        case 0x13: blurtexturesse<1, 3>(w, h, dst, src, margin); return;
+        case 0x23: blurtexturesse<2, 3>(w, h, dst, src, margin); return;
+        case 0x14: blurtexturesse<1, 4>(w, h, dst, src, margin); return;
+        case 0x24: blurtexturesse<2, 4>(w, h, dst, src, margin); return;
+    }
+#endif
     switch((clamp(n, 1, 2)<<4) | bpp)
     {
         case 0x13: blurtexture<1, 3, false>(w, h, dst, src, margin); break;
@@ -1103,6 +1314,97 @@ SDL_Surface *loadsurface(const char *name)
     if(!s) s = IMG_Load(findfile(name, "rb"));
     return fixsurfaceformat(s);
 }
+
+static void copyimage(const ImageData &s, ImageData &d)
+{
+    d.cleanup();
+    d.setdata(NULL, s.w, s.h, s.bpp);
+    readwritetex(d, s, memcpy(dst, src, s.bpp));
+}
+
+enum { TEXBENCH_HALVE = 0, TEXBENCH_PREMUL, TEXBENCH_MAD, TEXBENCH_BLUR1, TEXBENCH_BLUR2, NUMTEXBENCH };
+
+static bool runtexbench(int kernel, ImageData &s, ImageData &d)
+{
+    switch(kernel)
+    {
+        case TEXBENCH_HALVE:
+            if(s.w&1 || s.h&1) return false;
+            d.cleanup();
+            d.setdata(NULL, s.w/2, s.h/2, s.bpp);
+            scaletexture(s.data, s.w, s.h, s.bpp, s.pitch, d.data, d.w, d.h);
+            return true;
+        case TEXBENCH_PREMUL:
+            if(s.bpp != 2 && s.bpp != 4) return false;
+            copyimage(s, d);
+            texpremul(d);
+            return true;
+        case TEXBENCH_MAD:
+            copyimage(s, d);
+            texmad(d, vec(0.75f, 1.25f, 0.5f), vec(0.1f, -0.2f, 0.3f));
+            return true;
+        case TEXBENCH_BLUR1: case TEXBENCH_BLUR2:
+            if(s.bpp < 3) return false;
+            d.cleanup();
+            d.setdata(NULL, s.w, s.h, s.bpp);
+            blurtexture(kernel == TEXBENCH_BLUR2 ? 2 : 1, s.bpp, s.w, s.h, d.data, s.data);
+            return true;
+    }
+    return false;
+}
+
+void texsimdbench(char *dir, int *reps)
+{
+#ifndef TEXSSE
+    conoutf(CON_ERROR, "texture SIMD kernels are not available in this build");
+#else
+    static const char * const names[NUMTEXBENCH] = { "halve", "premul", "mad", "blur1", "blur2" };
+    vector<char *> files;
+    listfiles(dir, NULL, files);
+    int iters = *reps > 0 ? *reps : 10, oldsimd = texsimd, images = 0;
+    Uint32 millis[NUMTEXBENCH][2];
+    int runs[NUMTEXBENCH], mismatches[NUMTEXBENCH];
+    memset(millis, 0, sizeof(millis));
+    memset(runs, 0, sizeof(runs));
+    memset(mismatches, 0, sizeof(mismatches));
+    loopv(files)
+    {
+        defformatstring(file)("%s/%s", dir, files[i]);
+        SDL_Surface *surface = loadsurface(file);
+        if(!surface) continue;
+        ImageData orig(surface), s;
+        copyimage(orig, s);
+        images++;
+        loopj(NUMTEXBENCH)
+        {
+            ImageData out[2];
+            bool ok = true;
+            loopk(2)
+            {
+                texsimd = k;
+                Uint32 start = SDL_GetTicks();
+                loopl(iters) if(!(ok = runtexbench(j, s, out[k]))) break;
+                millis[j][k] += SDL_GetTicks() - start;
+                if(!ok) break;
+            }
+            if(!ok) continue;
+            runs[j]++;
+            if(out[0].w != out[1].w || out[0].h != out[1].h || memcmp(out[0].data, out[1].data, out[0].calcsize()))
+            {
+                mismatches[j]++;
+                conoutf(CON_ERROR, "%s: SIMD output differs for %s", names[j], file);
+            }
+        }
+    }
+    texsimd = oldsimd;
+    files.deletearrays();
+    if(!images) { conoutf(CON_ERROR, "no images found in %s", dir); return; }
+    loopj(NUMTEXBENCH) if(runs[j])
+        conoutf("%s: %d images, scalar %u ms, simd %u ms (%.2fx), %d mismatches", names[j], runs[j], millis[j][0], millis[j][1], millis[j][0]/float(max(millis[j][1], Uint32(1))), mismatches[j]);
+#endif
+}
+
+COMMAND(texsimdbench, "si");
    
 static vec parsevec(const char *arg)
 {
@@ -1120,33 +1422,76 @@ static vec parsevec(const char *arg)
 VAR(usedds, 0, 1, 1);
 VAR(dbgdds, 0, 0, 1);
 
-static bool texturedata(ImageData &d, const char *tname, Slot::Tex *tex = NULL, bool msg = true, int *compress = NULL)
+// textures decoded on the loader threads from file contents read on the main thread
+enum { TEXLOAD_QUEUED = 0, TEXLOAD_LOADING, TEXLOAD_DONE, TEXLOAD_FAILED };
+
+struct texloadjob
 {
-    const char *cmds = NULL, *file = tname;
+    char *name;
+    int type, clamp, compress, state;
+    bool slot, mipit;
+    uchar *filedata;
+    int filelen;
+    ImageData image;
+
+    texloadjob(const char *name, int type, bool slot) : name(newstring(name)), type(type), clamp(0), compress(0), state(TEXLOAD_QUEUED), slot(slot), mipit(true), filedata(NULL), filelen(0) {}
+    ~texloadjob() { DELETEA(name); DELETEA(filedata); }
+};
+
+static texloadjob *takeslotload(const Slot::Tex &tex);
 
+VARP(texcache, 0, 1, 1);
+
+static bool texcachekey(const char *name, int type, const char *file, string &key);
+static bool hastexcache(const char *key, bool compressed);
+static bool loadtexcache(const char *key, bool compressed, ImageData &d, int *compress);
+static void savetexcache(const char *key, ImageData &d, int compress);
+static void savecompressedtexcache(const char *key, Texture *t, int compress);
+
+static const char *texturefile(const char *tname, const char *texname, const char *&cmds, string &pname)
+{
+    const char *file = tname;
+    cmds = NULL;
     if(!tname)
     {
-        if(!tex) return false;
-        if(tex->name[0]=='<') 
+        if(texname[0]=='<')
         {
-            cmds = tex->name;
-            file = strrchr(tex->name, '>');
-            if(!file) { if(msg) conoutf(CON_ERROR, "could not load texture packages/%s", tex->name); return false; }
+            cmds = texname;
+            file = strrchr(texname, '>');
+            if(!file) return NULL;
             file++;
         }
-        else file = tex->name;
-        
-        static string pname;
+        else file = texname;
+
         formatstring(pname)("packages/%s", file);
         file = path(pname);
     }
-    else if(tname[0]=='<') 
+    else if(tname[0]=='<')
     {
         cmds = tname;
         file = strrchr(tname, '>');
-        if(!file) { if(msg) conoutf(CON_ERROR, "could not load texture %s", tname); return NULL; }
+        if(!file) return NULL;
         file++;
     }
+    return file;
+}
+
+static SDL_Surface *loadsurface(const uchar *data, int len, const char *name)
+{
+    SDL_RWops *rw = SDL_RWFromConstMem(data, len);
+    if(!rw) return NULL;
+    const char *ext = strrchr(name, '.');
+    return fixsurfaceformat(IMG_LoadTyped_RW(rw, 1, (char *)(ext ? ext+1 : "")));
+}
+
+static bool texturedata(ImageData &d, const char *tname, Slot::Tex *tex = NULL, bool msg = true, int *compress = NULL, texloadjob *job = NULL)
+{
+    if(!tname && !tex) return false;
+
+    const char *cmds = NULL;
+    string pname;
+    const char *file = texturefile(tname, tex ? tex->name : NULL, cmds, pname);
+    if(!file) { if(msg) conoutf(CON_ERROR, "could not load texture %s%s", tname ? "" : "packages/", tname ? tname : tex->name); return false; }
 
     bool raw = !usedds || !compress, dds = false;
     for(const char *pcmds = cmds; pcmds;)
@@ -1179,14 +1524,42 @@ static bool texturedata(ImageData &d, const char *tname, Slot::Tex *tex = NULL,
         }
         else if(!strncmp(cmd, "dds", len)) dds = true;
         else if(!strncmp(cmd, "thumbnail", len)) raw = true;
-        else if(!strncmp(cmd, "stub", len)) return canloadsurface(file);
+        else if(!strncmp(cmd, "stub", len)) return job ? job->filedata != NULL : canloadsurface(file);
+    }
+
+    int flen = strlen(file);
+    string cachekey;
+    bool cached = !job && cmds && !dds && (flen < 4 || strcasecmp(file + flen - 4, ".dds")) &&
+                  texcachekey(tname ? tname : tex->name, tex ? tex->type : -1, file, cachekey);
+
+    if(!job && !tname)
+    {
+        texloadjob *loaded = takeslotload(*tex);
+        if(loaded)
+        {
+            bool done = loaded->state == TEXLOAD_DONE;
+            if(done)
+            {
+                d.replace(loaded->image);
+                if(compress) *compress = loaded->compress;
+                if(cached) savetexcache(cachekey, d, loaded->compress);
+            }
+            delete loaded;
+            if(done)
+            {
+                if(msg) renderprogress(loadprogress, file);
+                return true;
+            }
+        }
     }
 
     if(msg) renderprogress(loadprogress, file);
 
-    int flen = strlen(file);
+    if(cached && loadtexcache(cachekey, false, d, compress)) return true;
+
     if(flen >= 4 && (!strcasecmp(file + flen - 4, ".dds") || dds))
     {
+        if(job) return false;
         string dfile;
         copystring(dfile, file);
         memcpy(dfile + flen - 4, ".dds", 4);
@@ -1194,11 +1567,11 @@ static bool texturedata(ImageData &d, const char *tname, Slot::Tex *tex = NULL,
         if(!dds || dbgdds) { if(msg) conoutf(CON_ERROR, "could not load texture %s", dfile); return false; }
     }
         
-    SDL_Surface *s = loadsurface(file);
+    SDL_Surface *s = job ? loadsurface(job->filedata, job->filelen, file) : loadsurface(file);
     if(!s) { if(msg) conoutf(CON_ERROR, "could not load texture %s", file); return false; }
     int bpp = s->format->BitsPerPixel;
-    if(bpp%8 || !texformat(bpp/8)) { SDL_FreeSurface(s); conoutf(CON_ERROR, "texture must be 8, 16, 24, or 32 bpp: %s", file); return false; }
-    if(max(s->w, s->h) > (1<<12)) { SDL_FreeSurface(s); conoutf(CON_ERROR, "texture size exceeded %dx%d pixels: %s", 1<<12, 1<<12, file); return false; }
+    if(bpp%8 || !texformat(bpp/8)) { SDL_FreeSurface(s); if(!job) conoutf(CON_ERROR, "texture must be 8, 16, 24, or 32 bpp: %s", file); return false; }
+    if(max(s->w, s->h) > (1<<12)) { SDL_FreeSurface(s); if(!job) conoutf(CON_ERROR, "texture size exceeded %dx%d pixels: %s", 1<<12, 1<<12, file); return false; }
     d.wrap(s);
 
     while(cmds)
@@ -1254,6 +1627,7 @@ static bool texturedata(ImageData &d, const char *tname, Slot::Tex *tex = NULL,
         }
     }
 
+    if(cached) savetexcache(cachekey, d, compress ? *compress : 0);
     return true;
 }
 
@@ -1286,10 +1660,241 @@ Texture *textureload(const char *name, int clamp, bool mipit, bool msg)
     if(t) return t;
     int compress = 0;
     ImageData s;
-    if(texturedata(s, tname, NULL, msg, &compress)) return newtexture(NULL, tname, s, clamp, mipit, false, false, compress);
+    const char *cmds = NULL;
+    string pname, cachekey;
+    const char *file = texturefile(tname, NULL, cmds, pname);
+    bool cached = file && texcachekey(tname, -1, file, cachekey);
+    if(cached && loadtexcache(cachekey, true, s, &compress)) return newtexture(NULL, tname, s, clamp, mipit, false, false, compress);
+    if(texturedata(s, tname, NULL, msg, &compress)) 
+    {
+        t = newtexture(NULL, tname, s, clamp, mipit, false, false, compress);
+        if(cached && !s.compressed) savecompressedtexcache(cachekey, t, compress);
+        return t;
+    }
     return notexture;
 }
 
+// loader threads: file contents are read on the main thread since the stream and zip layers are not thread-safe,
+// decoding and the texture commands run on the workers, and GL uploads stay on the main thread
+
+VARP(texthreads, 0, 0, 16);
+VARP(texuploads, 1, 4, 64);
+
+#define MAXTEXLOADREADY 32
+#define MAXPREFETCHBYTES (128<<20)
+
+static SDL_mutex *texloadmutex = NULL;
+static SDL_cond *texloadwork = NULL, *texloaddone = NULL;
+static vector<SDL_Thread *> texloadthreads;
+static vector<texloadjob *> texloadqueue, asyncpending;
+static hashtable<const char *, texloadjob *> slotloads, asyncloads;
+static int texloadready = 0;
+
+static void runtexload(texloadjob *job)
+{
+    Slot::Tex tex;
+    tex.type = job->type;
+    tex.t = NULL;
+    tex.combined = -1;
+    copystring(tex.name, job->name);
+    bool loaded = texturedata(job->image, job->slot ? NULL : job->name, job->slot ? &tex : NULL, false, &job->compress, job);
+    DELETEA(job->filedata);
+    SDL_LockMutex(texloadmutex);
+    job->state = loaded ? TEXLOAD_DONE : TEXLOAD_FAILED;
+    texloadready++;
+    SDL_CondBroadcast(texloaddone);
+    SDL_UnlockMutex(texloadmutex);
+}
+
+static int texloadthread(void *data)
+{
+    SDL_LockMutex(texloadmutex);
+    for(;;)
+    {
+        while(texloadqueue.empty() || texloadready >= MAXTEXLOADREADY) SDL_CondWait(texloadwork, texloadmutex);
+        texloadjob *job = texloadqueue.remove(0);
+        job->state = TEXLOAD_LOADING;
+        SDL_UnlockMutex(texloadmutex);
+        runtexload(job);
+        SDL_LockMutex(texloadmutex);
+    }
+    SDL_UnlockMutex(texloadmutex);
+    return 0;
+}
+
+static bool starttexloads()
+{
+    if(texloadthreads.length()) return true;
+    if(!texloadmutex) texloadmutex = SDL_CreateMutex();
+    if(!texloadwork) texloadwork = SDL_CreateCond();
+    if(!texloaddone) texloaddone = SDL_CreateCond();
+    if(!texloadmutex || !texloadwork || !texloaddone) return false;
+#if SDL_IMAGE_MAJOR_VERSION > 1 || SDL_IMAGE_MINOR_VERSION > 2 || SDL_IMAGE_PATCHLEVEL >= 10
+    // load the decoder libraries up front instead of racing to do so on the workers
+    IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+#endif
+    int numthreads = texthreads > 0 ? texthreads : numcpus;
+    loopi(numthreads)
+    {
+        SDL_Thread *thread = SDL_CreateThread(texloadthread, NULL);
+        if(thread) texloadthreads.add(thread);
+    }
+    return texloadthreads.length() > 0;
+}
+
+// reads the file a job decodes, leaving DDS files to the synchronous path since they need no decoding
+static bool readtexload(texloadjob *job)
+{
+    const char *cmds = NULL;
+    string pname, cachekey;
+    const char *file = job->slot ? texturefile(NULL, job->name, cmds, pname) : texturefile(job->name, NULL, cmds, pname);
+    if(!file) return false;
+    int flen = strlen(file);
+    if((flen >= 4 && !strcasecmp(file + flen - 4, ".dds")) || (cmds && strstr(cmds, "<dds"))) return false;
+    // cached textures skip decoding entirely, so leave them to the synchronous path
+    if(texcachekey(job->name, job->slot ? job->type : -1, file, cachekey) && (hastexcache(cachekey, true) || (cmds && hastexcache(cachekey, false)))) return false;
+    job->filedata = (uchar *)loadfile(file, &job->filelen, false);
+    return job->filedata != NULL;
+}
+
+static void queuetexload(texloadjob *job)
+{
+    SDL_LockMutex(texloadmutex);
+    texloadqueue.add(job);
+    SDL_CondSignal(texloadwork);
+    SDL_UnlockMutex(texloadmutex);
+}
+
+// waits for a finished job, or decodes it here if no worker has picked it up yet
+static void finishtexload(texloadjob *job)
+{
+    SDL_LockMutex(texloadmutex);
+    if(job->state == TEXLOAD_QUEUED)
+    {
+        texloadqueue.removeobj(job);
+        job->state = TEXLOAD_LOADING;
+        SDL_UnlockMutex(texloadmutex);
+        runtexload(job);
+        SDL_LockMutex(texloadmutex);
+    }
+    else while(job->state == TEXLOAD_LOADING) SDL_CondWait(texloaddone, texloadmutex);
+    texloadready--;
+    SDL_CondSignal(texloadwork);
+    SDL_UnlockMutex(texloadmutex);
+}
+
+static texloadjob *takeslotload(const Slot::Tex &tex)
+{
+    texloadjob **found = slotloads.numelems ? slotloads.access(tex.name) : NULL;
+    if(!found || (*found)->type != tex.type) return NULL;
+    texloadjob *job = *found;
+    slotloads.remove(tex.name);
+    finishtexload(job);
+    return job;
+}
+
+static void addprefetchslot(Slot &slot, int &bytes)
+{
+    if(slot.loaded) return;
+    loopv(slot.sts)
+    {
+        Slot::Tex &t = slot.sts[i];
+        switch(t.type)
+        {
+            case TEX_ENVMAP: continue;
+            case TEX_DIFFUSE: case TEX_GLOW: case TEX_DECAL: case TEX_NORMAL: case TEX_SPEC: break;
+            default: if(renderpath==R_FIXEDFUNCTION) continue; break;
+        }
+        if(slotloads.access(t.name)) continue;
+        texloadjob *job = new texloadjob(t.name, t.type, true);
+        if(!readtexload(job)) { delete job; continue; }
+        bytes += job->filelen;
+        slotloads[job->name] = job;
+        queuetexload(job);
+    }
+}
+
+void prefetchtextures(const vector<int> &texs)
+{
+    if(!starttexloads()) return;
+    int bytes = 0;
+    loopv(texs)
+    {
+        // anything past the budget of file contents held in memory just loads synchronously
+        if(bytes >= MAXPREFETCHBYTES) break;
+        VSlot &vslot = lookupvslot(texs[i], false);
+        addprefetchslot(*vslot.slot, bytes);
+        if(vslot.layer) addprefetchslot(*lookupvslot(vslot.layer, false).slot, bytes);
+    }
+}
+
+// unused prefetches that no worker has picked up yet are dropped without decoding them
+static void dropslotload(texloadjob *job)
+{
+    SDL_LockMutex(texloadmutex);
+    bool queued = job->state == TEXLOAD_QUEUED;
+    if(queued) texloadqueue.removeobj(job);
+    SDL_UnlockMutex(texloadmutex);
+    if(!queued) finishtexload(job);
+    delete job;
+}
+
+void finishprefetchtextures()
+{
+    if(!slotloads.numelems) return;
+    enumerate(slotloads, texloadjob *, job, dropslotload(job));
+    slotloads.clear();
+}
+
+// returns NULL while the texture is still loading, so callers can draw a placeholder
+Texture *asynctextureload(const char *name, int clamp, bool mipit)
+{
+    string tname;
+    copystring(tname, name);
+    Texture *t = textures.access(path(tname));
+    if(t) return t;
+    texloadjob **pending = asyncloads.access(tname);
+    if(pending) return (*pending)->state == TEXLOAD_FAILED ? notexture : NULL;
+    if(!starttexloads()) return textureload(tname, clamp, mipit, false);
+    texloadjob *job = new texloadjob(tname, TEX_DIFFUSE, false);
+    if(!readtexload(job))
+    {
+        delete job;
+        return textureload(tname, clamp, mipit, false);
+    }
+    job->clamp = clamp;
+    job->mipit = mipit;
+    asyncloads[job->name] = job;
+    asyncpending.add(job);
+    queuetexload(job);
+    return NULL;
+}
+
+void flushasynctextures()
+{
+    if(asyncpending.empty()) return;
+    vector<texloadjob *> finished;
+    SDL_LockMutex(texloadmutex);
+    loopv(asyncpending)
+    {
+        texloadjob *job = asyncpending[i];
+        if(job->state < TEXLOAD_DONE || (job->state == TEXLOAD_DONE && finished.length() >= texuploads)) continue;
+        finished.add(job);
+        asyncpending.remove(i--);
+        texloadready--;
+    }
+    if(finished.length()) SDL_CondSignal(texloadwork);
+    SDL_UnlockMutex(texloadmutex);
+    loopv(finished)
+    {
+        texloadjob *job = finished[i];
+        if(job->state == TEXLOAD_FAILED) { job->image.cleanup(); continue; }
+        if(!textures.access(job->name)) newtexture(NULL, job->name, job->image, job->clamp, job->mipit, false, false, job->compress);
+        asyncloads.remove(job->name);
+        delete job;
+    }
+}
+
 bool settexture(const char *name, int clamp)
 {
     Texture *t = textureload(name, clamp, true, false);
@@ -1964,7 +2569,18 @@ static void texcombine(Slot &s, int index, Slot::Tex &t, bool forceload = false)
     if(t.t) return;
     int compress = 0;
     ImageData ts;
-    if(!texturedata(ts, NULL, &t, true, &compress)) { t.t = notexture; return; }
+    // the compressed cache only holds single source textures, since combining needs the uncompressed pixels
+    const char *cmds = NULL;
+    string pname, cachekey;
+    const char *file = key.find('&') < 0 ? texturefile(NULL, t.name, cmds, pname) : NULL;
+    bool cached = file && texcachekey(t.name, t.type, file, cachekey);
+    if(cached && loadtexcache(cachekey, true, ts, &compress))
+    {
+        texloadjob *loaded = takeslotload(t);
+        if(loaded) delete loaded;
+        renderprogress(loadprogress, file);
+    }
+    else if(!texturedata(ts, NULL, &t, true, &compress)) { t.t = notexture; return; }
     switch(t.type)
     {
         case TEX_DIFFUSE:
@@ -2006,6 +2622,7 @@ static void texcombine(Slot &s, int index, Slot::Tex &t, bool forceload = false)
             break;
     }
     t.t = newtexture(NULL, key.getbuf(), ts, 0, true, true, true, compress);
+    if(cached && !ts.compressed) savecompressedtexcache(cachekey, t.t, compress);
 }
 
 static Slot &loadslot(Slot &s, bool forceload)
@@ -2642,17 +3259,15 @@ struct DDSURFACEDESC2
     uint dwTextureStage;   
 };
 
-bool loaddds(const char *filename, ImageData &image)
+static bool readdds(stream *f, ImageData &image, const char *filename)
 {
-    stream *f = openfile(filename, "rb");
-    if(!f) return false;
     GLenum format = GL_FALSE;
     uchar magic[4];
-    if(f->read(magic, 4) != 4 || memcmp(magic, "DDS ", 4)) { delete f; return false; }
+    if(f->read(magic, 4) != 4 || memcmp(magic, "DDS ", 4)) return false;
     DDSURFACEDESC2 d;
-    if(f->read(&d, sizeof(d)) != sizeof(d)) { delete f; return false; }
+    if(f->read(&d, sizeof(d)) != sizeof(d)) return false;
     lilswap((uint *)&d, sizeof(d)/sizeof(uint));
-    if(d.dwSize != sizeof(DDSURFACEDESC2) || d.ddpfPixelFormat.dwSize != sizeof(DDPIXELFORMAT)) { delete f; return false; }
+    if(d.dwSize != sizeof(DDSURFACEDESC2) || d.ddpfPixelFormat.dwSize != sizeof(DDPIXELFORMAT)) return false;
     if(d.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
     {
         switch(d.ddpfPixelFormat.dwFourCC)
@@ -2664,8 +3279,23 @@ bool loaddds(const char *filename, ImageData &image)
             case FOURCC_DXT5: format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
         }        
     }
-    if(!format) { delete f; return false; }
-    if(dbgdds) conoutf(CON_DEBUG, "%s: format 0x%X, %d x %d, %d mipmaps", filename, format, d.dwWidth, d.dwHeight, d.dwMipMapCount);
+    else if(d.ddpfPixelFormat.dwFlags & (DDPF_RGB | DDPF_LUMINANCE))
+    {
+        // only the byte order written by writedds is accepted for uncompressed images
+        int bpp = d.ddpfPixelFormat.dwRGBBitCount/8;
+        if(d.ddpfPixelFormat.dwRGBBitCount != uint(bpp*8) || bpp < 1 || bpp > 4 || 
+           d.ddpfPixelFormat.dwRBitMask != 0xFF || 
+           (bpp > 2 && (d.ddpfPixelFormat.dwGBitMask != 0xFF00 || d.ddpfPixelFormat.dwBBitMask != 0xFF0000)) ||
+           (bpp == 2 || bpp == 4 ? d.ddpfPixelFormat.dwRGBAlphaBitMask != uint(0xFF)<<(8*(bpp-1)) : d.ddpfPixelFormat.dwRGBAlphaBitMask != 0))
+            return false;
+        if(dbgdds && filename) conoutf(CON_DEBUG, "%s: %d bpp, %d x %d", filename, bpp, d.dwWidth, d.dwHeight);
+        image.setdata(NULL, d.dwWidth, d.dwHeight, bpp);
+        int size = image.calcsize();
+        if(f->read(image.data, size) != size) { image.cleanup(); return false; }
+        return true;
+    }
+    if(!format) return false;
+    if(dbgdds && filename) conoutf(CON_DEBUG, "%s: format 0x%X, %d x %d, %d mipmaps", filename, format, d.dwWidth, d.dwHeight, d.dwMipMapCount);
     int bpp = 0;
     switch(format)
     {
@@ -2676,8 +3306,109 @@ bool loaddds(const char *filename, ImageData &image)
     }
     image.setdata(NULL, d.dwWidth, d.dwHeight, bpp, d.dwMipMapCount, 4, format); 
     int size = image.calcsize();
-    if(f->read(image.data, size) != size) { delete f; image.cleanup(); return false; }
+    if(f->read(image.data, size) != size) { image.cleanup(); return false; }
+    return true;
+}
+
+bool loaddds(const char *filename, ImageData &image)
+{
+    stream *f = openfile(filename, "rb");
+    if(!f) return false;
+    bool loaded = readdds(f, image, filename);
     delete f;
+    return loaded;
+}
+
+static void writedds(stream *f, ImageData &image)
+{
+    DDSURFACEDESC2 d;
+    memset(&d, 0, sizeof(d));
+    d.dwSize = sizeof(DDSURFACEDESC2);
+    d.dwWidth = image.w;
+    d.dwHeight = image.h;
+    d.ddsCaps.dwCaps = DDSCAPS_TEXTURE;
+    d.ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
+    if(image.compressed)
+    {
+        d.dwLinearSize = image.calcsize();
+        d.dwMipMapCount = image.levels;
+        d.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
+        d.ddsCaps.dwCaps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+        d.ddpfPixelFormat.dwFlags = DDPF_FOURCC | (image.compressed!=GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? DDPF_ALPHAPIXELS : 0);
+        switch(image.compressed)
+        {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: d.ddpfPixelFormat.dwFourCC = FOURCC_DXT1; break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: d.ddpfPixelFormat.dwFourCC = FOURCC_DXT3; break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: d.ddpfPixelFormat.dwFourCC = FOURCC_DXT5; break;
+        }
+    }
+    else
+    {
+        d.lPitch = image.w*image.bpp;
+        d.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_PITCH;
+        d.ddpfPixelFormat.dwFlags = image.bpp >= 3 ? DDPF_RGB : DDPF_LUMINANCE;
+        if(image.bpp == 2 || image.bpp == 4) 
+        {
+            d.ddpfPixelFormat.dwFlags |= DDPF_ALPHAPIXELS;
+            d.ddpfPixelFormat.dwRGBAlphaBitMask = 0xFFU<<(8*(image.bpp-1));
+        }
+        d.ddpfPixelFormat.dwRGBBitCount = 8*image.bpp;
+        d.ddpfPixelFormat.dwRBitMask = 0xFF;
+        if(image.bpp >= 3) 
+        {
+            d.ddpfPixelFormat.dwGBitMask = 0xFF00;
+            d.ddpfPixelFormat.dwBBitMask = 0xFF0000;
+        }
+    }
+
+    lilswap((uint *)&d, sizeof(d)/sizeof(uint));
+
+    f->write("DDS ", 4);
+    f->write(&d, sizeof(d));
+    if(image.compressed) f->write(image.data, image.calcsize());
+    else
+    {
+        uchar *row = image.data;
+        loopi(image.h) { f->write(row, image.w*image.bpp); row += image.pitch; }
+    }
+}
+
+// reads back the mip chain the driver compressed for the currently bound 2D texture
+static bool getcompressedtexture(ImageData &image)
+{
+    GLint compressed = 0, format = 0, width = 0, height = 0; 
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_ARB, &compressed);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    if(!compressed) return false;
+
+    int bpp = 0;
+    switch(format)
+    {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: 
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: bpp = 8; break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: 
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: bpp = 16; break;
+        default: return false;
+    }
+    int levels = 1;
+    for(int lw = width, lh = height; max(lw, lh) > 1; levels++)
+    {
+        if(lw > 1) lw /= 2;
+        if(lh > 1) lh /= 2;
+    }
+    image.setdata(NULL, width, height, bpp, levels, 4, format);
+    uchar *dst = image.data;
+    loopi(levels)
+    {
+        GLint size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE_ARB, &size);
+        if(size != image.calclevelsize(i)) { image.cleanup(); return false; }
+        glGetCompressedTexImage_(GL_TEXTURE_2D, i, dst);
+        dst += size;
+    }
     return true;
 }
 
@@ -2695,23 +3426,14 @@ void gendds(char *infile, char *outfile)
     if(t==notexture) { conoutf(CON_ERROR, "failed loading %s", infile); return; }
 
     glBindTexture(GL_TEXTURE_2D, t->id);
-    GLint compressed = 0, format = 0, width = 0, height = 0; 
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_ARB, &compressed);
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
-    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
-
-    if(!compressed) { conoutf(CON_ERROR, "failed compressing %s", infile); return; }
-    int fourcc = 0;
-    switch(format)
+    ImageData image;
+    if(!getcompressedtexture(image)) { conoutf(CON_ERROR, "failed compressing %s", infile); return; }
+    switch(image.compressed)
     {
-        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: fourcc = FOURCC_DXT1; conoutf("compressed as DXT1"); break;
-        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: fourcc = FOURCC_DXT1; conoutf("compressed as DXT1a"); break;
-        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: fourcc = FOURCC_DXT3; conoutf("compressed as DXT3"); break;
-        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: fourcc = FOURCC_DXT5; conoutf("compressed as DXT5"); break;
-        default:
-            conoutf(CON_ERROR, "failed compressing %s: unknown format: 0x%X", infile, format); break;
-            return;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: conoutf("compressed as DXT1"); break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: conoutf("compressed as DXT1a"); break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: conoutf("compressed as DXT3"); break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: conoutf("compressed as DXT5"); break;
     }
 
     if(!outfile[0])
@@ -2726,56 +3448,86 @@ void gendds(char *infile, char *outfile)
     
     stream *f = openfile(path(outfile, true), "wb");
     if(!f) { conoutf(CON_ERROR, "failed writing to %s", outfile); return; } 
+    writedds(f, image);
+    delete f;
 
-    int csize = 0;
-    for(int lw = width, lh = height, level = 0;;)
-    {
-        GLint size = 0;
-        glGetTexLevelParameteriv(GL_TEXTURE_2D, level++, GL_TEXTURE_COMPRESSED_IMAGE_SIZE_ARB, &size);
-        csize += size;
-        if(max(lw, lh) <= 1) break;
-        if(lw > 1) lw /= 2;
-        if(lh > 1) lh /= 2;
-    }
+    conoutf("wrote DDS file %s", outfile);
 
-    DDSURFACEDESC2 d;
-    memset(&d, 0, sizeof(d));
-    d.dwSize = sizeof(DDSURFACEDESC2);
-    d.dwWidth = width;
-    d.dwHeight = height;
-    d.dwLinearSize = csize;
-    d.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
-    d.ddsCaps.dwCaps = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
-    d.ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
-    d.ddpfPixelFormat.dwFlags = DDPF_FOURCC | (format!=GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? DDPF_ALPHAPIXELS : 0);
-    d.ddpfPixelFormat.dwFourCC = fourcc;
-   
-    uchar *data = new uchar[csize], *dst = data;
-    for(int lw = width, lh = height;;)
+    setuptexcompress();
+}
+COMMAND(gendds, "ss");
+
+// processed and driver-compressed images are cached under cache/texture/, keyed by the texture name with its commands,
+// the source file's size and modification time, and the settings that affect the result
+#define TEXCACHEVERSION 1
+
+static bool texcachekey(const char *name, int type, const char *file, string &key)
+{
+    if(!texcache) return false;
+    size_t size = 0;
+    uint mtime = 0;
+    if(!getfileinfo(findfile(file, "rb"), size, mtime)) return false;
+    formatstring(key)("%d|%s|%d|%d|%d|%d|%d|%u|%u", TEXCACHEVERSION, name, type, renderpath, hasS3TC ? usetexcompress : 0, texcompress, texcompressquality, uint(size), mtime);
+    return true;
+}
+
+static const char *texcachefile(const char *key, bool compressed)
+{
+    static string name;
+    formatstring(name)("cache/texture/%08x%s.dds", uint(crc32(0, (const Bytef *)key, strlen(key))), compressed ? "c" : "");
+    return name;
+}
+
+static bool hastexcache(const char *key, bool compressed)
+{
+    return fileexists(findfile(texcachefile(key, compressed), "rb"), "r");
+}
+
+static bool loadtexcache(const char *key, bool compressed, ImageData &d, int *compress)
+{
+    stream *f = openrawfile(path(texcachefile(key, compressed), true), "rb");
+    if(!f) return false;
+    ImageData image;
+    int keylen = strlen(key), cachecompress = 0;
+    string cachekey;
+    bool loaded = readdds(f, image, NULL) && (image.compressed != 0) == compressed && (!compressed || hasS3TC);
+    if(loaded)
     {
-        GLint size;
-        glGetTexLevelParameteriv(GL_TEXTURE_2D, d.dwMipMapCount, GL_TEXTURE_COMPRESSED_IMAGE_SIZE_ARB, &size);
-        glGetCompressedTexImage_(GL_TEXTURE_2D, d.dwMipMapCount++, dst);
-        dst += size;
-        if(max(lw, lh) <= 1) break;
-        if(lw > 1) lw /= 2;
-        if(lh > 1) lh /= 2;
+        cachecompress = f->getlil<int>();
+        loaded = f->read(cachekey, keylen+1) == keylen+1 && !memcmp(cachekey, key, keylen+1);
     }
+    delete f;
+    if(!loaded) return false;
+    d.replace(image);
+    if(compress) *compress = cachecompress;
+    return true;
+}
 
-    lilswap((uint *)&d, sizeof(d)/sizeof(uint));
-
-    f->write("DDS ", 4);
-    f->write(&d, sizeof(d));
-    f->write(data, csize);
+static void writetexcache(const char *key, bool compressed, ImageData &image, int compress)
+{
+    if(!createcachedir("texture")) return;
+    stream *f = openrawfile(path(texcachefile(key, compressed), true), "wb");
+    if(!f) return;
+    writedds(f, image);
+    f->putlil<int>(compress);
+    f->write(key, strlen(key)+1);
     delete f;
-    
-    delete[] data;
+}
 
-    conoutf("wrote DDS file %s", outfile);
+static void savetexcache(const char *key, ImageData &d, int compress)
+{
+    if(d.data && !d.compressed) writetexcache(key, false, d, compress);
+}
 
-    setuptexcompress();
+// only opaque textures are stored compressed, so alpha textures still get their alpha mask from the source pixels
+static void savecompressedtexcache(const char *key, Texture *t, int compress)
+{
+    if(!t || t==notexture || !t->id || !t->mipmap || t->type&(Texture::COMPRESSED|Texture::ALPHA|Texture::STUB) || t->w != t->xs || t->h != t->ys) return;
+    if(!hasS3TC || usetexcompress <= 1) return;
+    glBindTexture(GL_TEXTURE_2D, t->id);
+    ImageData image;
+    if(getcompressedtexture(image)) writetexcache(key, true, image, compress);
 }
-COMMAND(gendds, "ss");
 
 void writepngchunk(stream *f, const char *type, uchar *data = NULL, uint len = 0)
 {
@@ -313,6 +313,7 @@ undoblock *newundoent()
     if(numents <= 0) return NULL;
     undoblock *u = (undoblock *)new uchar[sizeof(undoblock) + numents*sizeof(undoent)];
     u->numents = numents;
+    u->packedlen = u->unpackedlen = 0;
     undoent *e = (undoent *)(u + 1);
     loopv(entgroup)
     {
@@ -868,12 +868,16 @@ void loadvslots(stream *f, int numvslots)
     delete[] prev;
 }
 
+VARP(savethreads, 0, 0, 16);
+
 bool save_world(const char *mname, bool nolms)
 {
     if(!*mname) mname = game::getclientmap();
     setmapfilenames(*mname ? mname : "untitled");
     if(savebak) backup(ogzname, bakname);
-    stream *f = opengzfile(ogzname, "wb");
+    int numthreads = savethreads > 0 ? savethreads : numcpus;
+    bool parallel = numthreads > 1;
+    stream *f = parallel ? openparallelgzfile(ogzname, "wb", numthreads) : opengzfile(ogzname, "wb");
     if(!f) { conoutf(CON_WARN, "could not write map to %s", ogzname); return false; }
 
     int numvslots = vslots.length();
@@ -983,22 +987,38 @@ bool save_world(const char *mname, bool nolms)
     }
     if(shouldsaveblendmap()) { renderprogress(0, "saving blendmap..."); saveblendmap(f); }
 
-    delete f;
+    renderprogress(0, "compressing map...");
+    bool written = true;
+    if(parallel) written = closeparallelgzfile(f);
+    else delete f;
+    if(!written) { conoutf(CON_ERROR, "could not write map to %s", ogzname); return false; }
     conoutf("wrote map file %s", ogzname);
     return true;
 }
 
 static uint mapcrc = 0;
 
+VARP(asyncmapload, 0, 1, 1);
+VAR(dbgmapload, 0, 0, 1);
+
+static void logloadphase(const char *phase, Uint32 &last)
+{
+    Uint32 now = SDL_GetTicks();
+    if(dbgmapload) conoutf(CON_DEBUG, "%s: %.3f seconds", phase, (now - last)/1000.0f);
+    last = now;
+}
+
 uint getmapcrc() { return mapcrc; }
 void clearmapcrc() { mapcrc = 0; }
 
 bool load_world(const char *mname, const char *cname)        // still supports all map formats that have existed since the earliest cube betas!
 {
     int loadingstart = SDL_GetTicks();
+    Uint32 loadingphase = loadingstart;
     setmapfilenames(mname, cname);
     stream *f = opengzfile(ogzname, "rb");
     if(!f) { conoutf(CON_ERROR, "could not read map %s", ogzname); return false; }
+    if(asyncmapload && numcpus > 1) f = openasyncstream(f);
     octaheader hdr;
     if(f->read(&hdr, 7*sizeof(int))!=int(7*sizeof(int))) { conoutf(CON_ERROR, "map %s has malformatted header", ogzname); delete f; return false; }
     lilswap(&hdr.version, 6);
@@ -1054,11 +1074,15 @@ bool load_world(const char *mname, const char *cname)        // still supports a
         else lilswap(&hdr.numvslots, 1);
     }
 
+    logloadphase("header", loadingphase);
+
     renderprogress(0, "clearing world...");
 
     freeocta(worldroot);
     worldroot = NULL;
 
+    logloadphase("clearing world", loadingphase);
+
     setvar("mapsize", hdr.worldsize, true, false);
     int worldscale = 0;
     while(1<<worldscale < hdr.worldsize) worldscale++;
@@ -1195,17 +1219,25 @@ bool load_world(const char *mname, const char *cname)        // still supports a
         f->seek((hdr.numents-MAXENTS)*(samegame ? sizeof(entity) + einfosize : eif), SEEK_CUR);
     }
 
+    logloadphase("loading vars and entities", loadingphase);
+
     renderprogress(0, "loading slots...");
     loadvslots(f, hdr.numvslots);
 
+    logloadphase("loading slots", loadingphase);
+
     renderprogress(0, "loading octree...");
     bool failed = false;
     worldroot = loadchildren(f, ivec(0, 0, 0), hdr.worldsize>>1, failed);
     if(failed) conoutf(CON_ERROR, "garbage in map");
 
+    logloadphase("loading octree", loadingphase);
+
     renderprogress(0, "validating...");
     validatec(worldroot, hdr.worldsize>>1);
 
+    logloadphase("validating", loadingphase);
+
     if(!failed)
     {
         if(hdr.version >= 7) loopi(hdr.lightmaps)
@@ -1228,8 +1260,12 @@ bool load_world(const char *mname, const char *cname)        // still supports a
             lm.finalize();
         }
 
+        logloadphase("loading lightmaps", loadingphase);
+
         if(hdr.version >= 25 && hdr.numpvs > 0) loadpvs(f, hdr.numpvs);
         if(hdr.version >= 28 && hdr.blendmap) loadblendmap(f, hdr.blendmap);
+
+        logloadphase("loading pvs and blendmap", loadingphase);
     }
 
     mapcrc = f->getcrc();
@@ -1243,6 +1279,8 @@ bool load_world(const char *mname, const char *cname)        // still supports a
     execfile("data/default_map_settings.cfg", false);
     execfile(cfgname, false);
     identflags &= ~IDF_OVERRIDDEN;
+
+    logloadphase("executing map config", loadingphase);
    
     extern void fixlightmapnormals();
     if(hdr.version <= 25) fixlightmapnormals();
@@ -1254,13 +1292,19 @@ bool load_world(const char *mname, const char *cname)        // still supports a
     game::preload();
     flushpreloadedmodels();
 
+    logloadphase("preloading models", loadingphase);
+
     preloadmapsounds();
 
+    logloadphase("preloading sounds", loadingphase);
+
     entitiesinoctanodes();
     attachentities();
     initlights();
     allchanged(true);
 
+    logloadphase("building geometry", loadingphase);
+
     renderbackground("loading...", mapshot, mname, game::getmapinfo());
 
     if(maptitle[0] && strcmp(maptitle, "Untitled Map by Unknown")) conoutf(CON_ECHO, "%s", maptitle);
@@ -48,11 +48,13 @@ namespace game
         int anger;                          // how many times already hit by fellow monster
         physent *stacked;
         vec stackpos;
+        int losquery;                       // pending line of sight check, answered next frame
     
         monster(int _type, int _yaw, int _tag, int _state, int _trigger, int _move) :
             monsterstate(_state), tag(_tag),
             stacked(NULL),
-            stackpos(0, 0, 0)
+            stackpos(0, 0, 0),
+            losquery(-1)
         {
             type = ENT_AI;
             respawn();
@@ -161,7 +163,9 @@ namespace game
                     || (monsterhurt && o.dist(monsterhurtpos)<128))
                     {
                         vec target;
-                        if(raycubelos(o, enemy->o, target))
+                        int los = checklos(losquery, target);
+                        losquery = queuelos(o, enemy->o);
+                        if(los > 0 || (losquery < 0 && raycubelos(o, enemy->o, target)))
                         {
                             transition(M_HOME, 1, 500, 200);
                             playsound(S_GRUNT1+rnd(2), &o);
@@ -26,6 +26,7 @@ enum
     CODE_LOOKUP, CODE_LOOKUPU, CODE_LOOKUPARG, CODE_ALIAS, CODE_ALIASU, CODE_ALIASARG, CODE_CALL, CODE_CALLU, CODE_CALLARG,
     CODE_PRINT,
     CODE_LOCAL,
+    NUMCODES,
 
     CODE_OP_MASK = 0x3F,
     CODE_RET = 6,
@@ -48,6 +48,8 @@ extern float raycube   (const vec &o, const vec &ray,     float radius = 0, int
 extern float raycubepos(const vec &o, const vec &ray, vec &hit, float radius = 0, int mode = RAY_CLIPMAT, int size = 0);
 extern float rayfloor  (const vec &o, vec &floor, int mode = 0, float radius = 0);
 extern bool  raycubelos(const vec &o, const vec &dest, vec &hitpos);
+extern int   queuelos(const vec &o, const vec &dest);
+extern int   checklos(int id, vec &hitpos);
 
 extern int thirdperson;
 extern bool isthirdperson();
@@ -293,6 +293,22 @@ bool fileexists(const char *path, const char *mode)
     return exists;
 }
 
+bool getfileinfo(const char *path, size_t &size, uint &mtime)
+{
+#ifdef WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if(!GetFileAttributesEx(path, GetFileExInfoStandard, &info) || info.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY) return false;
+    size = info.nFileSizeLow;
+    mtime = uint(((ullong(info.ftLastWriteTime.dwHighDateTime)<<32) | info.ftLastWriteTime.dwLowDateTime)/10000000);
+#else
+    struct stat info;
+    if(stat(path, &info) < 0 || !S_ISREG(info.st_mode)) return false;
+    size = info.st_size;
+    mtime = uint(info.st_mtime);
+#endif
+    return true;
+}
+
 bool createdir(const char *path)
 {
     size_t len = strlen(path);
@@ -308,6 +324,16 @@ bool createdir(const char *path)
 #endif
 }
 
+// makes sure cache/<kind>/ exists under the home dir, for subsystems keeping processed data on disk
+bool createcachedir(const char *kind)
+{
+    const char *dir = findfile("cache/", "w");
+    if(!fileexists(dir, "w")) createdir(dir);
+    defformatstring(name)("cache/%s/", kind);
+    dir = findfile(name, "w");
+    return fileexists(dir, "w") || createdir(dir);
+}
+
 size_t fixpackagedir(char *dir)
 {
     path(dir);
@@ -341,12 +367,88 @@ bool subhomedir(char *dst, int len, const char *src)
     return true;
 }
 
+struct dirlisting
+{
+    vector<char *> names;
+    hashtable<const char *, int> index;
+
+    dirlisting(int size) : index(size) {}
+    ~dirlisting() { names.deletearrays(); }
+};
+
+static hashtable<const char *, dirlisting *> dirlistings;
+static int filecachehits = 0, filecachemisses = 0;
+
+void clearfilecache()
+{
+    enumeratekt(dirlistings, const char *, dir, dirlisting *, listing, { delete[] (char *)dir; delete listing; });
+    dirlistings.clear();
+}
+
+static void invalidatefilecache(const char *path)
+{
+    vector<const char *> stale;
+    enumeratekt(dirlistings, const char *, dir, dirlisting *, listing, { if(!strncmp(path, dir, strlen(dir))) { delete listing; stale.add(dir); } });
+    loopv(stale)
+    {
+        const char *dir = stale[i];
+        dirlistings.remove(dir);
+        delete[] (char *)dir;
+    }
+}
+
+static dirlisting *listcacheddir(const char *dir)
+{
+    dirlisting **cached = dirlistings.access(dir);
+    if(cached) { filecachehits++; return *cached; }
+    filecachemisses++;
+    vector<char *> files;
+    listdir(dir[0] ? dir : ".", false, NULL, files);
+    int size = 16;
+    while(size < files.length()) size *= 2;
+    dirlisting *listing = new dirlisting(size);
+    listing->names.move(files);
+    loopv(listing->names)
+    {
+#ifdef WIN32
+        for(char *c = listing->names[i]; *c; c++) *c = tolower(*c);
+#endif
+        listing->index[listing->names[i]] = 1;
+    }
+    dirlistings[newstring(dir)] = listing;
+    return listing;
+}
+
+static bool cachedfileexists(const char *path)
+{
+    string dir;
+    const char *name = strrchr(path, PATHDIV);
+    if(name) copystring(dir, path, ++name - path + 1);
+    else { dir[0] = '\0'; name = path; }
+    dirlisting *listing = listcacheddir(dir);
+#ifdef WIN32
+    string lname;
+    copystring(lname, name);
+    for(char *c = lname; *c; c++) *c = tolower(*c);
+    name = lname;
+#endif
+    return listing->index.access(name) != NULL;
+}
+
+VARF(filecache, 0, 1, 1, clearfilecache());
+
+static inline bool findfileexists(const char *path, const char *mode)
+{
+    return filecache && mode[0]=='r' ? cachedfileexists(path) : fileexists(path, mode);
+}
+
 const char *sethomedir(const char *dir)
 {
     string pdir;
     copystring(pdir, dir);
     if(!subhomedir(pdir, sizeof(pdir), dir) || !fixpackagedir(pdir)) return NULL;
     copystring(homedir, pdir);
+    clearfilecache();
     return homedir;
 }
 
@@ -369,6 +471,7 @@ const char *addpackagedir(const char *dir)
     pf.dirlen = filter ? filter-pdir : strlen(pdir);
     pf.filter = filter ? newstring(filter) : NULL;
     pf.filterlen = filter ? strlen(filter) : 0;
+    clearfilecache();
     return pf.dir;
 }
 
@@ -378,7 +481,8 @@ const char *findfile(const char *filename, const char *mode)
     if(homedir[0])
     {
         formatstring(s)("%s%s", homedir, filename);
-        if(fileexists(s, mode)) return s;
+        if(mode[0]=='w' || mode[0]=='a') invalidatefilecache(s);
+        if(findfileexists(s, mode)) return s;
         if(mode[0]=='w' || mode[0]=='a')
         {
             string dirs;
@@ -400,11 +504,22 @@ const char *findfile(const char *filename, const char *mode)
         packagedir &pf = packagedirs[i];
         if(pf.filter && strncmp(filename, pf.filter, pf.filterlen)) continue;
         formatstring(s)("%s%s", pf.dir, filename);
-        if(fileexists(s, mode)) return s;
+        if(findfileexists(s, mode)) return s;
     }
     return filename;
 }
 
+#ifndef STANDALONE
+void filecachestats()
+{
+    int dirs = 0, files = 0;
+    enumerate(dirlistings, dirlisting *, listing, { dirs++; files += listing->names.length(); });
+    conoutf("file cache: %d directories, %d entries, %d hits, %d misses", dirs, files, filecachehits, filecachemisses);
+}
+
+COMMAND(filecachestats, "");
+#endif
+
 bool listdir(const char *dirname, bool rel, const char *ext, vector<char *> &files)
 {
     int extsize = ext ? (int)strlen(ext)+1 : 0;
@@ -664,10 +779,11 @@ struct gzstream : stream
     z_stream zfile;
     uchar *buf;
     bool reading, writing, autoclose;
-    uint crc;
+    uint crc, trailercrc, trailersize;
     int headersize;
+    bool checktrailer;
 
-    gzstream() : file(NULL), buf(NULL), reading(false), writing(false), autoclose(false), crc(0), headersize(0)
+    gzstream() : file(NULL), buf(NULL), reading(false), writing(false), autoclose(false), crc(0), trailercrc(0), trailersize(0), headersize(0), checktrailer(false)
     {
         zfile.zalloc = NULL;
         zfile.zfree = NULL;
@@ -766,23 +882,33 @@ struct gzstream : stream
 
     uint getcrc() { return crc; }
 
+    // may run on an asyncstream's reader thread, so the trailer is only checked here and reported by close()
     void finishreading()
     {
         if(!reading) return;
 #ifndef STANDALONE
         if(dbggz)
         {
-            uint checkcrc = 0, checksize = 0;
-            loopi(4) checkcrc |= uint(readbyte()) << (i*8);
-            loopi(4) checksize |= uint(readbyte()) << (i*8);
-            if(checkcrc != crc)
-                conoutf(CON_DEBUG, "gzip crc check failed: read %X, calculated %X", checkcrc, crc);
-            if(checksize != zfile.total_out)
-                conoutf(CON_DEBUG, "gzip size check failed: read %u, calculated %u", checksize, uint(zfile.total_out));
+            trailercrc = trailersize = 0;
+            loopi(4) trailercrc |= uint(readbyte()) << (i*8);
+            loopi(4) trailersize |= uint(readbyte()) << (i*8);
+            checktrailer = true;
         }
 #endif
     }
 
+    void reporttrailer()
+    {
+        if(!checktrailer) return;
+        checktrailer = false;
+#ifndef STANDALONE
+        if(trailercrc != crc)
+            conoutf(CON_DEBUG, "gzip crc check failed: read %X, calculated %X", trailercrc, crc);
+        if(trailersize != zfile.total_out)
+            conoutf(CON_DEBUG, "gzip size check failed: read %u, calculated %u", trailersize, uint(zfile.total_out));
+#endif
+    }
+
     void stopreading()
     {
         if(!reading) return;
@@ -819,6 +945,7 @@ struct gzstream : stream
     {
         if(reading) finishreading();
         stopreading();
+        reporttrailer();
         if(writing) finishwriting();
         stopwriting();
         DELETEA(buf);
@@ -1099,6 +1226,348 @@ struct utf8stream : stream
     }
 };
 
+#ifndef STANDALONE
+struct asyncstream : stream
+{
+    enum
+    {
+        BLOCKSIZE = 256*1024,
+        MAXBLOCKS = 16
+    };
+
+    struct block
+    {
+        uchar *data;
+        int len;
+    };
+
+    stream *file;
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *filled, *drained;
+    block blocks[MAXBLOCKS];
+    int head, tail, curpos, crcpos;
+    block *cur;
+    bool eof, stopping, reading, autoclose;
+    offset pos;
+    uint crc;
+
+    asyncstream() : file(NULL), thread(NULL), lock(NULL), filled(NULL), drained(NULL), head(0), tail(0), curpos(0), crcpos(0), cur(NULL), eof(false), stopping(false), reading(false), autoclose(false), pos(0), crc(0)
+    {
+        loopi(MAXBLOCKS) { blocks[i].data = NULL; blocks[i].len = 0; }
+    }
+
+    ~asyncstream()
+    {
+        close();
+    }
+
+    static int fill(void *data)
+    {
+        asyncstream *s = (asyncstream *)data;
+        for(;;)
+        {
+            SDL_LockMutex(s->lock);
+            while(s->tail - s->head >= MAXBLOCKS && !s->stopping) SDL_CondWait(s->drained, s->lock);
+            if(s->stopping) { SDL_UnlockMutex(s->lock); break; }
+            block &b = s->blocks[s->tail%MAXBLOCKS];
+            SDL_UnlockMutex(s->lock);
+
+            b.len = s->file->read(b.data, BLOCKSIZE);
+
+            SDL_LockMutex(s->lock);
+            if(b.len > 0) s->tail++;
+            if(b.len < BLOCKSIZE) s->eof = true;
+            SDL_CondSignal(s->filled);
+            bool done = s->eof;
+            SDL_UnlockMutex(s->lock);
+            if(done) break;
+        }
+        return 0;
+    }
+
+    bool open(stream *f, bool needclose)
+    {
+        if(file) return false;
+        lock = SDL_CreateMutex();
+        filled = SDL_CreateCond();
+        drained = SDL_CreateCond();
+        if(!lock || !filled || !drained) return false;
+        loopi(MAXBLOCKS) blocks[i].data = new uchar[BLOCKSIZE];
+        file = f;
+        autoclose = needclose;
+        crc = crc32(0, NULL, 0);
+        thread = SDL_CreateThread(fill, this);
+        if(!thread) { file = NULL; autoclose = false; return false; }
+        reading = true;
+        return true;
+    }
+
+    void updatecrc()
+    {
+        if(cur && curpos > crcpos) crc = crc32(crc, &cur->data[crcpos], curpos - crcpos);
+        crcpos = curpos;
+    }
+
+    bool nextblock()
+    {
+        updatecrc();
+        SDL_LockMutex(lock);
+        if(cur) { cur = NULL; head++; SDL_CondSignal(drained); }
+        while(head >= tail && !eof) SDL_CondWait(filled, lock);
+        if(head < tail) cur = &blocks[head%MAXBLOCKS];
+        SDL_UnlockMutex(lock);
+        curpos = crcpos = 0;
+        if(!cur) { reading = false; return false; }
+        return true;
+    }
+
+    void close()
+    {
+        if(thread)
+        {
+            SDL_LockMutex(lock);
+            stopping = true;
+            SDL_CondSignal(drained);
+            SDL_UnlockMutex(lock);
+            SDL_WaitThread(thread, NULL);
+            thread = NULL;
+        }
+        reading = false;
+        cur = NULL;
+        loopi(MAXBLOCKS) DELETEA(blocks[i].data);
+        if(lock) { SDL_DestroyMutex(lock); lock = NULL; }
+        if(filled) { SDL_DestroyCond(filled); filled = NULL; }
+        if(drained) { SDL_DestroyCond(drained); drained = NULL; }
+        if(autoclose) DELETEP(file);
+    }
+
+    bool end() { return !reading; }
+    offset tell() { return reading ? pos : -1; }
+    offset size() { return -1; }
+
+    bool seek(offset off, int whence)
+    {
+        if(!reading) return false;
+
+        if(whence == SEEK_END)
+        {
+            if(cur) { pos += cur->len - curpos; curpos = cur->len; }
+            while(nextblock()) { pos += cur->len; curpos = cur->len; }
+            return !off;
+        }
+        else if(whence == SEEK_SET) off -= pos;
+
+        if(off < 0) return false;
+        while(off > 0)
+        {
+            if(!cur || curpos >= cur->len) { if(nextblock()) continue; return false; }
+            int skipped = (int)min(off, (offset)(cur->len - curpos));
+            curpos += skipped;
+            pos += skipped;
+            off -= skipped;
+        }
+        return true;
+    }
+
+    int read(void *buf, int len)
+    {
+        if(!reading || !buf || !len) return 0;
+        int next = 0;
+        while(next < len)
+        {
+            if(!cur || curpos >= cur->len) { if(nextblock()) continue; break; }
+            int n = min(len - next, cur->len - curpos);
+            memcpy(&((uchar *)buf)[next], &cur->data[curpos], n);
+            next += n;
+            curpos += n;
+        }
+        pos += next;
+        return next;
+    }
+
+    int getchar()
+    {
+        if(!cur || curpos >= cur->len) { if(!reading || !nextblock()) return -1; }
+        pos++;
+        return cur->data[curpos++];
+    }
+
+    uint getcrc() { updatecrc(); return crc; }
+};
+
+struct pgzstream : stream
+{
+    enum
+    {
+        BLOCKSIZE = 128*1024,
+        DICTSIZE  = 32*1024,
+        OS_UNIX   = 0x03
+    };
+
+    struct block
+    {
+        int start, len, complen;
+        uchar *comp;
+        uint crc;
+    };
+
+    stream *file;
+    vector<uchar> data;
+    vector<block> blocks;
+    SDL_mutex *lock;
+    int level, numthreads, nextblock;
+    bool writing, autoclose, failed;
+
+    pgzstream() : file(NULL), lock(NULL), level(Z_BEST_COMPRESSION), numthreads(1), nextblock(0), writing(false), autoclose(false), failed(false)
+    {
+    }
+
+    ~pgzstream()
+    {
+        close();
+    }
+
+    bool open(stream *f, bool needclose, int threads, int complevel)
+    {
+        if(file) return false;
+        file = f;
+        autoclose = needclose;
+        numthreads = max(threads, 1);
+        level = complevel;
+        writing = true;
+        return true;
+    }
+
+    void compressblock(block &b, int complevel)
+    {
+        z_stream zfile;
+        zfile.zalloc = NULL;
+        zfile.zfree = NULL;
+        zfile.opaque = NULL;
+        b.crc = crc32(crc32(0, NULL, 0), data.getbuf() + b.start, b.len);
+        b.comp = NULL;
+        b.complen = 0;
+        if(deflateInit2(&zfile, complevel, Z_DEFLATED, -MAX_WBITS, min(MAX_MEM_LEVEL, 8), Z_DEFAULT_STRATEGY) != Z_OK) return;
+        if(b.start > 0)
+        {
+            int dictlen = min(b.start, int(DICTSIZE));
+            deflateSetDictionary(&zfile, data.getbuf() + b.start - dictlen, dictlen);
+        }
+        int bound = deflateBound(&zfile, b.len) + 16;
+        b.comp = new uchar[bound];
+        zfile.next_in = data.getbuf() + b.start;
+        zfile.avail_in = b.len;
+        zfile.next_out = b.comp;
+        zfile.avail_out = bound;
+        bool last = b.start + b.len >= data.length();
+        int err = deflate(&zfile, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if(err == (last ? Z_STREAM_END : Z_OK) && !zfile.avail_in) b.complen = bound - zfile.avail_out;
+        else DELETEA(b.comp);
+        deflateEnd(&zfile);
+    }
+
+    static int compressworker(void *data)
+    {
+        pgzstream *s = (pgzstream *)data;
+        for(;;)
+        {
+            if(s->lock) SDL_LockMutex(s->lock);
+            int i = s->nextblock++;
+            if(s->lock) SDL_UnlockMutex(s->lock);
+            if(i >= s->blocks.length()) break;
+            s->compressblock(s->blocks[i], s->level);
+        }
+        return 0;
+    }
+
+    void finishwriting()
+    {
+        if(!writing) return;
+        writing = false;
+        for(int start = 0; start < data.length() || blocks.empty(); start += BLOCKSIZE)
+        {
+            block &b = blocks.add();
+            b.start = start;
+            b.len = min(int(BLOCKSIZE), data.length() - start);
+        }
+        nextblock = 0;
+        vector<SDL_Thread *> threads;
+        int maxthreads = min(numthreads, blocks.length());
+        if(maxthreads > 1 && (lock = SDL_CreateMutex())) loopi(maxthreads-1)
+        {
+            SDL_Thread *thread = SDL_CreateThread(compressworker, this);
+            if(!thread) break;
+            threads.add(thread);
+        }
+        compressworker(this);
+        loopv(threads) SDL_WaitThread(threads[i], NULL);
+        if(lock) { SDL_DestroyMutex(lock); lock = NULL; }
+        // retry blocks that failed on a worker here, storing them uncompressed as a last resort
+        loopv(blocks)
+        {
+            block &b = blocks[i];
+            if(!b.comp) compressblock(b, level);
+            if(!b.comp) compressblock(b, Z_NO_COMPRESSION);
+            if(!b.comp)
+            {
+                conoutf(CON_ERROR, "could not compress block %d of %d", i+1, blocks.length());
+                loopj(blocks.length()) DELETEA(blocks[j].comp);
+                blocks.setsize(0);
+                failed = true;
+                return;
+            }
+        }
+
+        uchar header[] = { 0x1F, 0x8B, Z_DEFLATED, 0, 0, 0, 0, 0, 0, OS_UNIX };
+        file->write(header, sizeof(header));
+        uint crc = crc32(0, NULL, 0);
+        loopv(blocks)
+        {
+            block &b = blocks[i];
+            file->write(b.comp, b.complen);
+            crc = crc32_combine(crc, b.crc, b.len);
+        }
+        uint size = uint(data.length());
+        uchar trailer[8] =
+        {
+            uchar(crc&0xFF), uchar((crc>>8)&0xFF), uchar((crc>>16)&0xFF), uchar((crc>>24)&0xFF),
+            uchar(size&0xFF), uchar((size>>8)&0xFF), uchar((size>>16)&0xFF), uchar((size>>24)&0xFF)
+        };
+        file->write(trailer, sizeof(trailer));
+        loopv(blocks) DELETEA(blocks[i].comp);
+        blocks.setsize(0);
+    }
+
+    void close()
+    {
+        finishwriting();
+        data.setsize(0);
+        if(autoclose) DELETEP(file);
+    }
+
+    bool end() { return !writing; }
+    offset tell() { return writing ? data.length() : -1; }
+    offset size() { return data.length(); }
+
+    int write(const void *buf, int len)
+    {
+        if(!writing || !buf || len <= 0) return 0;
+        data.put((const uchar *)buf, len);
+        return len;
+    }
+
+    bool putchar(int c)
+    {
+        if(!writing) return false;
+        data.add(uchar(c));
+        return true;
+    }
+
+    uint getcrc() { return crc32(crc32(0, NULL, 0), data.getbuf(), data.length()); }
+};
+#endif
+
 stream *openrawfile(const char *filename, const char *mode)
 {
     const char *found = findfile(filename, mode);
@@ -1134,6 +1603,33 @@ stream *opengzfile(const char *filename, const char *mode, stream *file, int lev
     return gz;
 }
 
+#ifndef STANDALONE
+stream *openasyncstream(stream *file)
+{
+    asyncstream *async = new asyncstream;
+    if(!async->open(file, true)) { delete async; return file; }
+    return async;
+}
+
+stream *openparallelgzfile(const char *filename, const char *mode, int threads, int level)
+{
+    stream *source = openfile(filename, mode);
+    if(!source) return NULL;
+    pgzstream *gz = new pgzstream;
+    if(!gz->open(source, true, threads, level)) { delete gz; delete source; return NULL; }
+    return gz;
+}
+
+bool closeparallelgzfile(stream *file)
+{
+    pgzstream *gz = (pgzstream *)file;
+    gz->close();
+    bool ok = !gz->failed;
+    delete gz;
+    return ok;
+}
+#endif
+
 stream *openutf8file(const char *filename, const char *mode, stream *file)
 {
     stream *source = file ? file : openfile(filename, mode);
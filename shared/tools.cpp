@@ -6,6 +6,9 @@
 #include <unistd.h>
 #endif
 
+bool countallocs = false;
+THREADLOCAL uint numallocs = 0;
+
 int guessnumcpus()
 {
     int numcpus = 1;
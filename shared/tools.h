@@ -26,16 +26,29 @@ typedef unsigned long long int ullong;
 #define RESTRICT
 #endif
 
+#if defined(__GNUC__)
+#define THREADLOCAL __thread
+#elif defined(_MSC_VER)
+#define THREADLOCAL __declspec(thread)
+#else
+#define THREADLOCAL
+#endif
+
+extern bool countallocs;            // only set while the script profiler runs
+extern THREADLOCAL uint numallocs;  // heap allocations made by this thread while countallocs is set
+
 inline void *operator new(size_t size)
 {
     void *p = malloc(size);
     if(!p) abort();
+    if(countallocs) numallocs++;
     return p;
 }
 inline void *operator new[](size_t size)
 {
     void *p = malloc(size);
     if(!p) abort();
+    if(countallocs) numallocs++;
     return p;
 }
 inline void operator delete(void *p) { if(p) free(p); }
@@ -1165,17 +1178,25 @@ extern char *path(char *s);
 extern char *path(const char *s, bool copy);
 extern const char *parentdir(const char *directory);
 extern bool fileexists(const char *path, const char *mode);
+extern bool getfileinfo(const char *path, size_t &size, uint &mtime);
 extern bool createdir(const char *path);
+extern bool createcachedir(const char *kind);
 extern size_t fixpackagedir(char *dir);
 extern const char *sethomedir(const char *dir);
 extern const char *addpackagedir(const char *dir);
 extern const char *findfile(const char *filename, const char *mode);
+extern void clearfilecache();
 extern stream *openrawfile(const char *filename, const char *mode);
 extern stream *openzipfile(const char *filename, const char *mode);
 extern stream *openfile(const char *filename, const char *mode);
 extern stream *opentempfile(const char *filename, const char *mode);
 extern stream *opengzfile(const char *filename, const char *mode, stream *file = NULL, int level = Z_BEST_COMPRESSION);
 extern stream *openutf8file(const char *filename, const char *mode, stream *file = NULL);
+#ifndef STANDALONE
+extern stream *openasyncstream(stream *file);
+extern stream *openparallelgzfile(const char *filename, const char *mode, int threads, int level = Z_BEST_COMPRESSION);
+extern bool closeparallelgzfile(stream *file);
+#endif
 extern char *loadfile(const char *fn, int *size, bool utf8 = true);
 extern bool listdir(const char *dir, bool rel, const char *ext, vector<char *> &files);
 extern int listfiles(const char *dir, const char *ext, vector<char *> &files);
@@ -1,5 +1,13 @@
 #include "cube.h"
 
+#ifdef WIN32
+#include <io.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 enum
 {
     ZIP_LOCAL_FILE_SIGNATURE = 0x04034B50,
@@ -58,15 +66,59 @@ struct ziparchive
     hashtable<const char *, zipfile> files;
     int openfiles;
     zipstream *owner;
+    uchar *mapped;
+    uint mappedsize;
+#ifdef WIN32
+    HANDLE mapping;
+#endif
 
-    ziparchive() : name(NULL), data(NULL), files(512), openfiles(0), owner(NULL)
+    ziparchive(int size = 512) : name(NULL), data(NULL), files(size), openfiles(0), owner(NULL), mapped(NULL), mappedsize(0)
+#ifdef WIN32
+      , mapping(NULL)
+#endif
     {
     }
     ~ziparchive()
     {
+        unmap();
         DELETEA(name);
         if(data) { fclose(data); data = NULL; }
     }
+
+    bool map()
+    {
+        if(mapped || !data) return mapped != NULL;
+        if(fseek(data, 0, SEEK_END) < 0) return false;
+        long len = ftell(data);
+        if(len <= 0) return false;
+#ifdef WIN32
+        mapping = CreateFileMapping((HANDLE)_get_osfhandle(_fileno(data)), NULL, PAGE_READONLY, 0, 0, NULL);
+        if(!mapping) return false;
+        mapped = (uchar *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!mapped) { CloseHandle(mapping); mapping = NULL; return false; }
+#else
+        void *view = mmap(NULL, len, PROT_READ, MAP_SHARED, fileno(data), 0);
+        if(view == MAP_FAILED) return false;
+        mapped = (uchar *)view;
+#endif
+        mappedsize = uint(len);
+        return true;
+    }
+
+    void unmap()
+    {
+        if(!mapped) return;
+#ifdef WIN32
+        UnmapViewOfFile(mapped);
+        if(mapping) { CloseHandle(mapping); mapping = NULL; }
+#else
+        munmap(mapped, mappedsize);
+#endif
+        mapped = NULL;
+        mappedsize = 0;
+    }
+
+    bool inrange(uint offset, uint len) const { return offset <= mappedsize && len <= mappedsize - offset; }
 };
 
 static bool findzipdirectory(FILE *f, zipdirectoryheader &hdr)
@@ -166,13 +218,8 @@ static bool readzipdirectory(const char *archname, FILE *f, int entries, int off
     return files.length() > 0;
 }
 
-static bool readlocalfileheader(FILE *f, ziplocalfileheader &h, uint offset)
+static bool parselocalfileheader(const uchar *src, ziplocalfileheader &h)
 {
-    fseek(f, offset, SEEK_SET);
-    uchar buf[ZIP_LOCAL_FILE_SIZE];
-    if(fread(buf, 1, ZIP_LOCAL_FILE_SIZE, f) != ZIP_LOCAL_FILE_SIZE)
-        return false;
-    uchar *src = buf;
     h.signature = lilswap(*(uint *)src); src += 4;
     h.version = lilswap(*(ushort *)src); src += 2;
     h.flags = lilswap(*(ushort *)src); src += 2;
@@ -189,6 +236,22 @@ static bool readlocalfileheader(FILE *f, ziplocalfileheader &h, uint offset)
     return true;
 }
 
+static bool readlocalfileheader(FILE *f, ziplocalfileheader &h, uint offset)
+{
+    fseek(f, offset, SEEK_SET);
+    uchar buf[ZIP_LOCAL_FILE_SIZE];
+    if(fread(buf, 1, ZIP_LOCAL_FILE_SIZE, f) != ZIP_LOCAL_FILE_SIZE)
+        return false;
+    return parselocalfileheader(buf, h);
+}
+
+static bool readlocalfileheader(ziparchive *a, ziplocalfileheader &h, uint offset)
+{
+    if(a->mapped) return a->inrange(offset, ZIP_LOCAL_FILE_SIZE) && parselocalfileheader(&a->mapped[offset], h);
+    a->owner = NULL;
+    return readlocalfileheader(a->data, h, offset);
+}
+
 static vector<ziparchive *> archives;
 
 ziparchive *findzip(const char *name)
@@ -259,6 +322,10 @@ static void mountzip(ziparchive &arch, vector<zipfile> &files, const char *mount
     }
 }
 
+#ifndef STANDALONE
+VARP(zipmmap, 0, 1, 1);
+#endif
+
 bool addzip(const char *name, const char *mount = NULL, const char *strip = NULL)
 {
     string pname;
@@ -289,9 +356,14 @@ bool addzip(const char *name, const char *mount = NULL, const char *strip = NULL
         return false;
     }
     
-    ziparchive *arch = new ziparchive;
+    int tablesize = 512;
+    while(tablesize < files.length()) tablesize *= 2;
+    ziparchive *arch = new ziparchive(tablesize);
     arch->name = newstring(pname);
     arch->data = f;
+#ifndef STANDALONE
+    if(zipmmap && !arch->map() && dbgzip) conoutf(CON_DEBUG, "%s: could not map archive, using file reads", pname);
+#endif
     mountzip(*arch, files, mount, strip);
     archives.add(arch);
 
@@ -353,6 +425,7 @@ struct zipstream : stream
 
     void readbuf(uint size = BUFSIZE)
     {
+        if(arch->mapped) return;
         if(!zfile.avail_in) zfile.next_in = (Bytef *)buf;
         size = min(size, uint(&buf[BUFSIZE] - &zfile.next_in[zfile.avail_in]));
         if(arch->owner != this)
@@ -372,10 +445,10 @@ struct zipstream : stream
         if(f->offset == ~0U)
         {
             ziplocalfileheader h;
-            a->owner = NULL;
-            if(!readlocalfileheader(a->data, h, f->header)) return false;
+            if(!readlocalfileheader(a, h, f->header)) return false;
             f->offset = f->header + ZIP_LOCAL_FILE_SIZE + h.namelength + h.extralength;
         }
+        if(a->mapped && !a->inrange(f->offset, f->compressedsize ? f->compressedsize : f->size)) return false;
 
         if(f->compressedsize && inflateInit2(&zfile, -MAX_WBITS) != Z_OK) return false;
 
@@ -384,10 +457,21 @@ struct zipstream : stream
         info = f;
         reading = f->offset;
         ended = false;
-        if(f->compressedsize) buf = new uchar[BUFSIZE];
+        if(f->compressedsize)
+        {
+            if(a->mapped) rewindmapped();
+            else buf = new uchar[BUFSIZE];
+        }
         return true;
     }
 
+    void rewindmapped()
+    {
+        zfile.next_in = (Bytef *)&arch->mapped[info->offset];
+        zfile.avail_in = info->compressedsize;
+        reading = info->offset + info->compressedsize;
+    }
+
     void stopreading()
     {
         if(reading < 0) return;
@@ -422,6 +506,12 @@ struct zipstream : stream
                 default: return false;
             } 
             pos = clamp(pos, offset(info->offset), offset(info->offset + info->size));
+            if(arch->mapped)
+            {
+                reading = pos;
+                ended = false;
+                return true;
+            }
             arch->owner = NULL;
             if(fseek(arch->data, int(pos), SEEK_SET) < 0) return false;
             arch->owner = this;
@@ -453,7 +543,8 @@ struct zipstream : stream
         if(pos >= (offset)zfile.total_out) pos -= zfile.total_out;
         else 
         {
-            if(zfile.next_in && zfile.total_in <= uint(zfile.next_in - buf))
+            if(arch->mapped) rewindmapped();
+            else if(zfile.next_in && zfile.total_in <= uint(zfile.next_in - buf))
             {
                 zfile.avail_in += zfile.total_in;
                 zfile.next_in -= zfile.total_in;
@@ -485,6 +576,14 @@ struct zipstream : stream
         if(reading < 0 || !buf || !len) return 0;
         if(!info->compressedsize)
         {
+            if(arch->mapped)
+            {
+                int n = min(len, int(info->size + info->offset - reading));
+                memcpy(buf, &arch->mapped[reading], n);
+                reading += n;
+                if(n < len) ended = true;
+                return n;
+            }
             if(arch->owner != this)
             {
                 arch->owner = NULL;